@@ -0,0 +1,200 @@
+#include "arena.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_ARENA_MMAP 1
+#include <sys/mman.h>
+#endif
+
+Chip8Arena::Chip8Arena(unsigned int partitions, bool hugePages, size_t slabBytes)
+	:partition_list(partitions > 0 ? partitions : 1), huge_pages(hugePages)
+{
+	slot_size = (sizeof(Chip8) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+
+	slab_bytes = slabBytes > slot_size ? slabBytes : slot_size;
+	if(huge_pages)
+	{
+		slab_bytes = (slab_bytes + ARENA_HUGE_PAGE_SIZE - 1) / ARENA_HUGE_PAGE_SIZE * ARENA_HUGE_PAGE_SIZE;
+	}
+	slots_per_slab = slab_bytes / slot_size;
+
+	for(Partition& partition : partition_list)
+	{
+		partition.free_slots = nullptr;
+		partition.live = 0;
+	}
+}
+
+Chip8Arena::~Chip8Arena()
+{
+	forEach([](Chip8& chip8){ chip8.~Chip8(); });
+
+	for(Partition& partition : partition_list)
+	{
+		for(Slab& slab : partition.slabs)
+		{
+			freeSlab(slab);
+		}
+	}
+}
+
+Chip8* Chip8Arena::create(unsigned int partition, Chip8Engine engine)
+{
+	Partition& owner = partition_list[partition];
+
+	unsigned int slab_index;
+	unsigned int index;
+	if(owner.free_slots != nullptr)
+	{
+		slab_index = owner.free_slots->slab;
+		index = owner.free_slots->index;
+		owner.free_slots = owner.free_slots->next;
+	}
+	else
+	{
+		if(owner.slabs.empty() || owner.slabs.back().used == slots_per_slab)
+		{
+			owner.slabs.emplace_back();
+			if(!allocateSlab(owner.slabs.back()))
+			{
+				owner.slabs.pop_back();
+				return nullptr;
+			}
+		}
+		slab_index = owner.slabs.size() - 1;
+		index = owner.slabs.back().used++;
+	}
+
+	Slab& slab = owner.slabs[slab_index];
+	Chip8* chip8 = new(slab.memory + index * slot_size) Chip8(engine);
+	slab.live[index / 64U] |= 1ULL << (index % 64U);
+	owner.live++;
+	return chip8;
+}
+
+void Chip8Arena::destroy(unsigned int partition, Chip8* chip8)
+{
+	if(chip8 == nullptr)
+	{
+		return;
+	}
+
+	Partition& owner = partition_list[partition];
+	uint8_t* address = reinterpret_cast<uint8_t*>(chip8);
+	for(unsigned int slab_index = 0; slab_index < owner.slabs.size(); slab_index++)
+	{
+		Slab& slab = owner.slabs[slab_index];
+		if(address < slab.memory || address >= slab.memory + slab.bytes)
+		{
+			continue;
+		}
+
+		unsigned int index = (address - slab.memory) / slot_size;
+		chip8->~Chip8();
+		slab.live[index / 64U] &= ~(1ULL << (index % 64U));
+		owner.live--;
+
+		FreeSlot* freed = new(address) FreeSlot{owner.free_slots, slab_index, index};
+		owner.free_slots = freed;
+		return;
+	}
+}
+
+unsigned int Chip8Arena::partitions() const
+{
+	return partition_list.size();
+}
+
+size_t Chip8Arena::size(unsigned int partition) const
+{
+	return partition_list[partition].live;
+}
+
+size_t Chip8Arena::hugeSlabs() const
+{
+	size_t huge = 0;
+	for(Partition const& partition : partition_list)
+	{
+		for(Slab const& slab : partition.slabs)
+		{
+			huge += slab.huge;
+		}
+	}
+	return huge;
+}
+
+size_t Chip8Arena::slotSize() const
+{
+	return slot_size;
+}
+
+bool Chip8Arena::allocateSlab(Slab& slab)
+{
+	slab.bytes = slab_bytes;
+	slab.used = 0;
+	slab.live.assign((slots_per_slab + 63U) / 64U, 0);
+	slab.mapped = false;
+	slab.huge = false;
+	slab.memory = nullptr;
+
+#ifdef CHIP8_ARENA_MMAP
+#ifdef MAP_HUGETLB
+	//explicit huge pages only work when the system has some reserved, otherwise fall through
+	if(huge_pages)
+	{
+		void* memory = mmap(nullptr, slab_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if(memory != MAP_FAILED)
+		{
+			slab.memory = static_cast<uint8_t*>(memory);
+			slab.mapped = true;
+			slab.huge = true;
+			return true;
+		}
+	}
+#endif
+
+	//transparent huge pages need a 2 MB aligned range, so map a huge page extra and trim both ends
+	size_t padding = huge_pages ? ARENA_HUGE_PAGE_SIZE : 0;
+	void* memory = mmap(nullptr, slab_bytes + padding, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(memory == MAP_FAILED)
+	{
+		return false;
+	}
+
+	uint8_t* start = static_cast<uint8_t*>(memory);
+	if(padding > 0)
+	{
+		uint8_t* aligned = reinterpret_cast<uint8_t*>((reinterpret_cast<uintptr_t>(start) + padding - 1) / padding * padding);
+		if(aligned > start)
+		{
+			munmap(start, aligned - start);
+		}
+		if(start + padding > aligned)
+		{
+			munmap(aligned + slab_bytes, start + padding - aligned);
+		}
+		start = aligned;
+#ifdef MADV_HUGEPAGE
+		slab.huge = madvise(start, slab_bytes, MADV_HUGEPAGE) == 0;
+#endif
+	}
+
+	slab.memory = start;
+	slab.mapped = true;
+	return true;
+#else
+	slab.memory = static_cast<uint8_t*>(::operator new(slab_bytes, std::align_val_t(ARENA_ALIGNMENT), std::nothrow));
+	return slab.memory != nullptr;
+#endif
+}
+
+void Chip8Arena::freeSlab(Slab& slab)
+{
+#ifdef CHIP8_ARENA_MMAP
+	if(slab.mapped)
+	{
+		munmap(slab.memory, slab.bytes);
+		return;
+	}
+#endif
+	::operator delete(slab.memory, std::align_val_t(ARENA_ALIGNMENT));
+}
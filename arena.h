@@ -0,0 +1,123 @@
+#pragma once
+
+#include "chip-8.h"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+//instances start on their own cache line and never share one with a neighbour
+const size_t ARENA_ALIGNMENT = 64;
+const size_t ARENA_HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+//Bulk storage for tens of thousands of Chip8s. Machines are placed back to back in large slabs, each in a slot
+//of sizeof(Chip8) rounded up to ARENA_ALIGNMENT, so creating one is a pointer bump and stepping them all walks
+//memory in order. Slabs can be backed by 2 MB huge pages to cut TLB misses.
+//The slabs are split into partitions, one per worker thread, so threads never share a slab, a cache line or a lock.
+//A partition must only be used by one thread at a time, and forEach over every partition only while none are in use.
+//Only the machine state lives in the arena, the decode cache and JIT code of the Cached and Jit engines stay on the heap
+class Chip8Arena
+{
+public:
+
+	//slabBytes is rounded up to a whole number of huge pages when hugePages is set.
+	//without huge page support the slabs fall back to normal pages
+	Chip8Arena(unsigned int partitions, bool hugePages = false, size_t slabBytes = ARENA_HUGE_PAGE_SIZE);
+	~Chip8Arena();
+
+	Chip8Arena(Chip8Arena const&) = delete;
+	Chip8Arena& operator=(Chip8Arena const&) = delete;
+
+	//constructs a machine in the partition, reusing the slot of a destroyed one when there is one
+	Chip8* create(unsigned int partition, Chip8Engine engine = Chip8Engine::Table);
+	//destroys a machine created in the same partition
+	void destroy(unsigned int partition, Chip8* chip8);
+
+	//calls function(Chip8&) on every live machine in the partition, in memory order
+	template<typename Function>
+	void forEach(unsigned int partition, Function&& function);
+	//the same for every partition in turn
+	template<typename Function>
+	void forEach(Function&& function);
+
+	unsigned int partitions() const;
+	//live machines in the partition
+	size_t size(unsigned int partition) const;
+	//slabs mapped with huge pages, or with transparent huge pages requested for them
+	size_t hugeSlabs() const;
+	//bytes of each machine's slot
+	size_t slotSize() const;
+
+private:
+
+	struct Slab
+	{
+		uint8_t* memory;
+		size_t bytes;
+		unsigned int used;	//slots handed out by the bump pointer so far
+		std::vector<uint64_t> live;	//bit per slot
+		bool mapped;
+		bool huge;
+	};
+
+	//threaded through the slots of destroyed machines
+	struct FreeSlot
+	{
+		FreeSlot* next;
+		unsigned int slab;
+		unsigned int index;
+	};
+
+	//padded to a cache line so partitions used by different threads don't false-share
+	struct alignas(ARENA_ALIGNMENT) Partition
+	{
+		std::vector<Slab> slabs;
+		FreeSlot* free_slots;
+		size_t live;
+	};
+
+	bool allocateSlab(Slab& slab);
+	void freeSlab(Slab& slab);
+
+	Chip8* slot(Slab const& slab, unsigned int index) const;
+
+	std::vector<Partition> partition_list;
+	size_t slot_size;
+	size_t slab_bytes;
+	unsigned int slots_per_slab;
+	bool huge_pages;
+};
+
+inline Chip8* Chip8Arena::slot(Slab const& slab, unsigned int index) const
+{
+	return std::launder(reinterpret_cast<Chip8*>(slab.memory + index * slot_size));
+}
+
+template<typename Function>
+void Chip8Arena::forEach(unsigned int partition, Function&& function)
+{
+	for(Slab const& slab : partition_list[partition].slabs)
+	{
+		for(unsigned int word = 0; word < slab.live.size(); word++)
+		{
+			//walks the set bits, so runs of destroyed machines are skipped a word at a time
+			uint64_t bits = slab.live[word];
+			while(bits != 0)
+			{
+				unsigned int index = word * 64U + std::countr_zero(bits);
+				bits &= bits - 1U;
+				function(*slot(slab, index));
+			}
+		}
+	}
+}
+
+template<typename Function>
+void Chip8Arena::forEach(Function&& function)
+{
+	for(unsigned int partition = 0; partition < partition_list.size(); partition++)
+	{
+		forEach(partition, function);
+	}
+}
@@ -0,0 +1,236 @@
+#include "chip-8.h"
+#include "threadPool.h"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Headless batch runner: runs many ROMs/scenarios across a thread pool and writes one result line per run.
+//usage: chip8-batch [-j threads] [-o results.csv] [-f frames] [-i instructions per frame] [-r runs] [-e engine]
+//                   [-q quirks] [-S seed] [-s scenarios.txt] [rom ...]
+//
+//Each line of a scenario file is "<frames> <instructions per frame> <runs> <engine> <rom path>",
+//the rom path being the rest of the line so it may contain spaces. Lines starting with # are ignored.
+//ROMs given directly on the command line use the -f/-i/-r/-e values.
+//Run n of every scenario is seeded with seed + n, so the whole batch is reproducible.
+//Each ROM runs with the quirks chip8QuirksForRom picks for it unless -q names a quirk set for all of them.
+
+struct Scenario
+{
+	std::string rom;
+	unsigned int frames;
+	unsigned int instructions_per_frame;
+	unsigned int runs;
+	Chip8Engine engine;
+	Chip8Quirks quirks;
+};
+
+struct RunResult
+{
+	uint64_t display_hash;
+	uint64_t instructions;
+	uint64_t skipped;
+	double wall_ms;
+};
+
+bool readScenarios(char const* filename, std::vector<Scenario>& scenarios)
+{
+	std::ifstream file(filename);
+	if(!file.is_open())
+	{
+		std::cerr << "could not open " << filename << std::endl;
+		return false;
+	}
+
+	std::string line;
+	while(std::getline(file, line))
+	{
+		if(line.empty() || line[0] == '#')
+		{
+			continue;
+		}
+
+		std::istringstream fields(line);
+		Scenario scenario;
+		std::string engine;
+		fields >> scenario.frames >> scenario.instructions_per_frame >> scenario.runs >> engine >> std::ws;
+		std::getline(fields, scenario.rom);
+
+		if(fields.fail() && scenario.rom.empty())
+		{
+			std::cerr << filename << ": bad line: " << line << std::endl;
+			return false;
+		}
+		if(!parseChip8Engine(engine.c_str(), scenario.engine))
+		{
+			std::cerr << filename << ": unknown engine " << engine << std::endl;
+			return false;
+		}
+		scenarios.push_back(scenario);
+	}
+
+	return true;
+}
+
+RunResult runScenario(Scenario const& scenario, uint64_t seed)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	RunResult result;
+	std::unique_ptr<Chip8Variant> machine = createChip8(scenario.quirks, scenario.engine);
+	//the frame loop is compiled once per quirk set
+	std::visit([&](auto& Chip8_Emulator)
+	{
+		Chip8_Emulator.seed(seed);
+		Chip8_Emulator.loadROM(scenario.rom.c_str());
+		for(unsigned int frame = 0; frame < scenario.frames; frame++)
+		{
+			Chip8_Emulator.runFrame(scenario.instructions_per_frame);
+		}
+
+		result.display_hash = Chip8_Emulator.displayHash();
+		result.instructions = Chip8_Emulator.instructions();
+		result.skipped = Chip8_Emulator.skippedInstructions();
+	}, *machine);
+
+	auto end = std::chrono::steady_clock::now();
+	result.wall_ms = std::chrono::duration<double, std::milli>(end - start).count();
+	return result;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned int threads = std::thread::hardware_concurrency();
+	std::string output_name = "batch_results.csv";
+	uint64_t seed = 0;
+	Scenario defaults = {"", 600, 11, 1, Chip8Engine::Cached, Chip8Quirks::Modern};
+	bool quirks_given = false;
+	std::vector<Scenario> scenarios;
+
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if(arg == "-j" && has_value) threads = std::stoul(argv[++i]);
+		else if(arg == "-o" && has_value) output_name = argv[++i];
+		else if(arg == "-f" && has_value) defaults.frames = std::stoul(argv[++i]);
+		else if(arg == "-i" && has_value) defaults.instructions_per_frame = std::stoul(argv[++i]);
+		else if(arg == "-r" && has_value) defaults.runs = std::stoul(argv[++i]);
+		else if(arg == "-S" && has_value) seed = std::stoull(argv[++i]);
+		else if(arg == "-e" && has_value)
+		{
+			if(!parseChip8Engine(argv[++i], defaults.engine))
+			{
+				std::cerr << "unknown engine " << argv[i] << std::endl;
+				return -1;
+			}
+		}
+		else if(arg == "-q" && has_value)
+		{
+			if(!parseChip8Quirks(argv[++i], defaults.quirks))
+			{
+				std::cerr << "unknown quirks " << argv[i] << std::endl;
+				return -1;
+			}
+			quirks_given = true;
+		}
+		else if(arg == "-s" && has_value)
+		{
+			if(!readScenarios(argv[++i], scenarios))
+			{
+				return -1;
+			}
+		}
+		else if(arg[0] == '-')
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return -1;
+		}
+		else
+		{
+			Scenario scenario = defaults;
+			scenario.rom = arg;
+			scenarios.push_back(scenario);
+		}
+	}
+
+	if(scenarios.empty())
+	{
+		std::cerr << "usage: chip8-batch [-j threads] [-o results.csv] [-f frames] [-i instructions per frame] [-r runs] [-e engine] [-q quirks] [-S seed] [-s scenarios.txt] [rom ...]" << std::endl;
+		return -1;
+	}
+
+	for(auto& scenario : scenarios)
+	{
+		scenario.quirks = quirks_given ? defaults.quirks : chip8QuirksForRom(scenario.rom.c_str());
+	}
+
+	//checked up front, which also maps every ROM into the shared cache before the workers start
+	for(auto const& scenario : scenarios)
+	{
+		Chip8 probe;
+		if(!probe.loadROM(scenario.rom.c_str()))
+		{
+			std::cerr << "could not load " << scenario.rom << ", ROMs can be at most " << MAX_ROM_SIZE << " bytes" << std::endl;
+			return -1;
+		}
+	}
+
+	//one result slot per run so workers never contend on the output
+	struct Run
+	{
+		Scenario const* scenario;
+		unsigned int index;
+		RunResult result;
+	};
+	std::vector<Run> runs;
+	for(auto const& scenario : scenarios)
+	{
+		for(unsigned int i = 0; i < scenario.runs; i++)
+		{
+			runs.push_back({&scenario, i, {}});
+		}
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		ThreadPool pool(threads);
+		for(auto& run : runs)
+		{
+			pool.submit([&run, seed]{ run.result = runScenario(*run.scenario, seed + run.index); });
+		}
+		pool.wait();
+		threads = pool.size();
+	}
+	double wall_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	std::ofstream output(output_name);
+	if(!output.is_open())
+	{
+		std::cerr << "could not write " << output_name << std::endl;
+		return -1;
+	}
+
+	output << "rom,run,seed,engine,quirks,frames,instructions,skipped,wall_ms,display_hash\n";
+	uint64_t total_instructions = 0;
+	for(auto const& run : runs)
+	{
+		char hash[17];
+		std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)run.result.display_hash);
+
+		output << "\"" << run.scenario->rom << "\"," << run.index << "," << seed + run.index << "," << chip8EngineName(run.scenario->engine) << ","
+			<< chip8QuirksName(run.scenario->quirks) << ","
+			<< run.scenario->frames << "," << run.result.instructions << "," << run.result.skipped << ","
+			<< run.result.wall_ms << "," << hash << "\n";
+		total_instructions += run.result.instructions;
+	}
+
+	std::cout << runs.size() << " runs on " << threads << " threads in " << wall_seconds << " s, "
+		<< (total_instructions / wall_seconds) / 1000000.0 << " M instructions/s, results in " << output_name << std::endl;
+	return 0;
+}
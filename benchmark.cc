@@ -0,0 +1,494 @@
+#include "chip-8.h"
+#include "lockstep.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_BENCHMARK_RUSAGE 1
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+//Benchmark suite: runs every ROM headless on each engine for a fixed number of instructions with the same scripted
+//input and seed, and reports instructions/s, ns/instruction, emulated frames/s and peak RSS per ROM and engine.
+//Each ROM and engine runs in a child process where fork is available, so the peak RSS is that run's own.
+//Results are written as CSV, and given a baseline CSV from an earlier run every ROM and engine that got slower
+//or bigger by more than the threshold is flagged and the exit code is 1.
+//With -l it also compares LOCKSTEP_LANES copies of the ROM stepped one by one against the same copies in a Chip8Lockstep,
+//checking every lane ends up where its copy did and exiting with 1 if one doesn't
+//usage: chip8-benchmark [-n instructions] [-i instructions per frame] [-r repeats] [-e engine] [-o results.csv]
+//                       [-b baseline.csv] [-t threshold %] [-l] [rom ...]   (defaults to every file in ROMS/)
+
+#ifdef CHIP8_BENCHMARK_STATIC
+//chip8-benchmark-static links in CHIP8_STATIC_BENCHMARK_ROM translated by chip8-recompile, see CMakeLists.txt
+extern Chip8StaticProgram const chip8_static_program;
+#endif
+
+//every run is seeded the same so Cxkk draws the same numbers on every engine
+const uint64_t BENCHMARK_SEED = 0xC8;
+
+//scripted input: walks the keypad holding each key for KEY_HOLD_FRAMES then releasing it for as long,
+//enough to get most games past their title screens and reacting to input
+const uint32_t KEY_HOLD_FRAMES = 6;
+
+struct BenchmarkResult
+{
+	uint64_t instructions;
+	uint64_t frames;
+	double seconds;
+	long peak_rss_kb; //0 when it couldn't be measured for this run alone
+	uint64_t display_hash;
+};
+
+//peak resident set of the whole process so far, it never goes down so it is only the figure for one run in a process that ran nothing else
+long peakRssKb()
+{
+#ifdef CHIP8_BENCHMARK_RUSAGE
+	rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0)
+	{
+		return 0;
+	}
+#ifdef __APPLE__
+	return usage.ru_maxrss / 1024;
+#else
+	return usage.ru_maxrss;
+#endif
+#else
+	return 0;
+#endif
+}
+
+//the key the scripted input holds down on frame, NUM_KEYS when it holds none
+unsigned int scriptedKey(uint64_t frame)
+{
+	uint64_t step = frame / KEY_HOLD_FRAMES;
+	if(step % 2 == 0)
+	{
+		return (step / 2) % NUM_KEYS;
+	}
+	return NUM_KEYS;
+}
+
+void applyScriptedInput(Chip8& chip8, uint64_t frame)
+{
+	unsigned int held = scriptedKey(frame);
+	for(unsigned int key = 0; key < NUM_KEYS; key++)
+	{
+		chip8.keypad[key] = key == held ? 1 : 0;
+	}
+}
+
+//loads the recompiled blocks into a Static machine, false when this build has none or they are for another ROM
+bool useStaticProgram(Chip8& chip8)
+{
+#ifdef CHIP8_BENCHMARK_STATIC
+	return chip8.useStaticProgram(&chip8_static_program);
+#else
+	(void)chip8;
+	return false;
+#endif
+}
+
+BenchmarkResult runEngine(Chip8Engine engine, std::string const& rom, uint64_t instructions, unsigned int instructionsPerFrame)
+{
+	Chip8 Chip8_Emulator(engine);
+	Chip8_Emulator.seed(BENCHMARK_SEED);
+	Chip8_Emulator.loadROM(rom.c_str());
+	if(engine == Chip8Engine::Static)
+	{
+		useStaticProgram(Chip8_Emulator);
+	}
+
+	BenchmarkResult result = {};
+	auto start = std::chrono::steady_clock::now();
+	//runFrame ends every frame on the exact instruction count, so every engine runs the same instructions
+	while(Chip8_Emulator.instructions() < instructions)
+	{
+		applyScriptedInput(Chip8_Emulator, result.frames);
+		Chip8_Emulator.runFrame(instructionsPerFrame);
+		result.frames++;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	result.instructions = Chip8_Emulator.instructions();
+	result.seconds = std::chrono::duration<double>(end - start).count();
+	result.display_hash = Chip8_Emulator.displayHash();
+	return result;
+}
+
+//the fastest of the repeats, the slower ones mostly measure whatever else the machine was doing
+BenchmarkResult runRepeats(Chip8Engine engine, std::string const& rom, uint64_t instructions, unsigned int instructionsPerFrame, unsigned int repeats)
+{
+	BenchmarkResult result = runEngine(engine, rom, instructions, instructionsPerFrame);
+	for(unsigned int i = 1; i < repeats; i++)
+	{
+		BenchmarkResult repeat = runEngine(engine, rom, instructions, instructionsPerFrame);
+		if(repeat.seconds < result.seconds)
+		{
+			result = repeat;
+		}
+	}
+	return result;
+}
+
+//runs the repeats of one ROM and engine in a child process and takes its peak RSS, the parent's never comes back down
+//after a big run so it can't be blamed on the next one. Runs them in this process without an RSS figure when there's no fork
+bool runCase(Chip8Engine engine, std::string const& rom, uint64_t instructions, unsigned int instructionsPerFrame, unsigned int repeats, BenchmarkResult& result)
+{
+#ifdef CHIP8_BENCHMARK_RUSAGE
+	int results[2];
+	if(pipe(results) == 0)
+	{
+		pid_t child = fork();
+		if(child == 0)
+		{
+			close(results[0]);
+			BenchmarkResult measured = runRepeats(engine, rom, instructions, instructionsPerFrame, repeats);
+			measured.peak_rss_kb = peakRssKb();
+			bool written = write(results[1], &measured, sizeof(measured)) == (ssize_t)sizeof(measured);
+			_exit(written ? 0 : 1);
+		}
+
+		close(results[1]);
+		bool received = false;
+		if(child > 0)
+		{
+			received = read(results[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+			int status = 0;
+			received = waitpid(child, &status, 0) == child && WIFEXITED(status) && WEXITSTATUS(status) == 0 && received;
+		}
+		close(results[0]);
+		if(child > 0)
+		{
+			return received;
+		}
+	}
+#endif
+
+	result = runRepeats(engine, rom, instructions, instructionsPerFrame, repeats);
+	result.peak_rss_kb = 0;
+	return true;
+}
+
+struct LaneResult
+{
+	uint64_t instance_steps;
+	double scalar_seconds;
+	double lockstep_seconds;
+	double divergence; //fraction of lockstep steps where the lanes weren't all on the same opcode
+};
+
+//compares everything a lockstep lane holds
+bool sameLane(Chip8 const& a, Chip8 const& b)
+{
+	Chip8Snapshot x;
+	Chip8Snapshot y;
+	a.saveState(x);
+	b.saveState(y);
+	return x.instruction_count == y.instruction_count
+		&& std::memcmp(x.machine.memory, y.machine.memory, sizeof(x.machine.memory)) == 0
+		&& std::memcmp(x.machine.regesters, y.machine.regesters, sizeof(x.machine.regesters)) == 0
+		&& x.machine.pc == y.machine.pc && x.machine.index_regester == y.machine.index_regester
+		&& std::memcmp(x.machine.stack, y.machine.stack, sizeof(x.machine.stack)) == 0
+		&& x.machine.stack_pointer == y.machine.stack_pointer
+		&& a.delayTimer() == b.delayTimer() && a.soundTimer() == b.soundTimer()
+		&& std::memcmp(x.machine.display, y.machine.display, sizeof(x.machine.display)) == 0
+		&& x.machine.rng_state == y.machine.rng_state;
+}
+
+//runs LOCKSTEP_LANES machines of the ROM, each with its own seed and its own offset into the scripted input, one after
+//the other and then the same machines in a Chip8Lockstep. Both sides run instructionsPerFrame steps then tick the
+//timers once, the machines with idle skipping off since lockstep has none. returns false if any lane ended up
+//different from its machine, the timings of a run that didn't do the same work aren't worth comparing
+bool runLanes(std::string const& rom, uint64_t instructions, unsigned int instructionsPerFrame, LaneResult& result)
+{
+	std::vector<std::unique_ptr<Chip8>> machines;
+	std::unique_ptr<Chip8Lockstep> lockstep(new Chip8Lockstep());
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		machines.emplace_back(new Chip8(Chip8Engine::Switch));
+		machines.back()->seed(BENCHMARK_SEED + lane);
+		machines.back()->setIdleSkipping(false);
+		if(!machines.back()->loadROM(rom.c_str()))
+		{
+			return false;
+		}
+		lockstep->loadLane(lane, *machines.back());
+	}
+
+	uint64_t frames = std::max<uint64_t>(1, instructions / LOCKSTEP_LANES / instructionsPerFrame);
+	result.instance_steps = frames * instructionsPerFrame * LOCKSTEP_LANES;
+
+	auto start = std::chrono::steady_clock::now();
+	for(uint64_t frame = 0; frame < frames; frame++)
+	{
+		for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+		{
+			applyScriptedInput(*machines[lane], frame + lane);
+			machines[lane]->runFrame(instructionsPerFrame);
+		}
+	}
+	auto end = std::chrono::steady_clock::now();
+	result.scalar_seconds = std::chrono::duration<double>(end - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for(uint64_t frame = 0; frame < frames; frame++)
+	{
+		for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+		{
+			unsigned int held = scriptedKey(frame + lane);
+			for(unsigned int key = 0; key < NUM_KEYS; key++)
+			{
+				lockstep->keypad[key][lane] = key == held ? 1 : 0;
+			}
+		}
+		lockstep->runFrame(instructionsPerFrame);
+	}
+	end = std::chrono::steady_clock::now();
+	result.lockstep_seconds = std::chrono::duration<double>(end - start).count();
+	result.divergence = lockstep->steps() ? (double)lockstep->divergentSteps() / lockstep->steps() : 0;
+
+	std::unique_ptr<Chip8> stored(new Chip8(Chip8Engine::Switch));
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		lockstep->storeLane(lane, *stored);
+		if(!sameLane(*machines[lane], *stored))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+struct BaselineEntry
+{
+	double instructions_per_second;
+	long peak_rss_kb;
+};
+
+//reads the rom, engine, instructions_per_second and peak_rss_kb columns of an earlier results file, keyed by "rom,engine"
+bool readBaseline(char const* filename, std::map<std::string, BaselineEntry>& baseline)
+{
+	std::ifstream file(filename);
+	if(!file.is_open())
+	{
+		std::cerr << "could not open " << filename << std::endl;
+		return false;
+	}
+
+	std::string line;
+	std::getline(file, line);
+	while(std::getline(file, line))
+	{
+		//the rom is quoted since file names can contain commas
+		size_t rom_end = line.find("\",", 1);
+		if(line.empty() || line[0] != '"' || rom_end == std::string::npos)
+		{
+			continue;
+		}
+
+		std::string rom = line.substr(1, rom_end - 1);
+		std::vector<std::string> fields;
+		std::istringstream rest(line.substr(rom_end + 2));
+		std::string field;
+		while(std::getline(rest, field, ','))
+		{
+			fields.push_back(field);
+		}
+		if(fields.size() < 8)
+		{
+			std::cerr << filename << ": bad line: " << line << std::endl;
+			return false;
+		}
+
+		baseline[rom + "," + fields[0]] = {std::stod(fields[4]), std::stol(fields[7])};
+	}
+
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	uint64_t instructions = 10000000;
+	unsigned int instructions_per_frame = 11;
+	unsigned int repeats = 3;
+	double threshold = 5.0;
+	bool lanes = false;
+	std::string output_name = "benchmark_results.csv";
+	char const* baseline_name = nullptr;
+	//static needs blocks recompiled from one particular ROM, only chip8-benchmark-static has them
+	std::vector<Chip8Engine> engines;
+	for(Chip8Engine engine : CHIP8_ENGINES)
+	{
+#ifndef CHIP8_BENCHMARK_STATIC
+		if(engine == Chip8Engine::Static)
+		{
+			continue;
+		}
+#endif
+		engines.push_back(engine);
+	}
+	std::vector<std::string> roms;
+
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if(arg == "-n" && has_value) instructions = std::stoull(argv[++i]);
+		else if(arg == "-i" && has_value) instructions_per_frame = std::max(1UL, std::stoul(argv[++i]));
+		else if(arg == "-r" && has_value) repeats = std::max(1UL, std::stoul(argv[++i]));
+		else if(arg == "-o" && has_value) output_name = argv[++i];
+		else if(arg == "-b" && has_value) baseline_name = argv[++i];
+		else if(arg == "-t" && has_value) threshold = std::stod(argv[++i]);
+		else if(arg == "-l") lanes = true;
+		else if(arg == "-e" && has_value)
+		{
+			Chip8Engine engine;
+			if(!parseChip8Engine(argv[++i], engine))
+			{
+				std::cerr << "unknown engine " << argv[i] << std::endl;
+				return -1;
+			}
+#ifndef CHIP8_BENCHMARK_STATIC
+			if(engine == Chip8Engine::Static)
+			{
+				std::cerr << "the static engine needs a recompiled ROM, run chip8-benchmark-static instead" << std::endl;
+				return -1;
+			}
+#endif
+			engines.assign(1, engine);
+		}
+		else if(arg[0] == '-')
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			std::cerr << "usage: chip8-benchmark [-n instructions] [-i instructions per frame] [-r repeats] [-e engine] [-o results.csv] [-b baseline.csv] [-t threshold %] [-l] [rom ...]" << std::endl;
+			return -1;
+		}
+		else
+		{
+			roms.push_back(arg);
+		}
+	}
+
+	std::map<std::string, BaselineEntry> baseline;
+	if(baseline_name && !readBaseline(baseline_name, baseline))
+	{
+		return -1;
+	}
+
+	if(roms.empty())
+	{
+		for(auto const& entry : std::filesystem::directory_iterator("ROMS"))
+		{
+			if(entry.is_regular_file() && entry.path().filename().string()[0] != '.')
+			{
+				roms.push_back(entry.path().string());
+			}
+		}
+		std::sort(roms.begin(), roms.end());
+	}
+
+	std::ofstream output(output_name);
+	if(!output.is_open())
+	{
+		std::cerr << "could not write " << output_name << std::endl;
+		return -1;
+	}
+	output << "rom,engine,instructions,frames,seconds,instructions_per_second,ns_per_instruction,frames_per_second,peak_rss_kb,display_hash\n";
+
+	std::cout << "sizeof(Chip8): " << sizeof(Chip8) << " bytes" << std::endl;
+
+	unsigned int regressions = 0;
+	unsigned int failures = 0;
+	for(auto const& rom : roms)
+	{
+		Chip8 probe;
+		if(!probe.loadROM(rom.c_str()))
+		{
+			std::cerr << "skipping " << rom << ", it can't be read or doesn't fit in memory" << std::endl;
+			continue;
+		}
+		std::cout << rom << std::endl;
+
+		for(Chip8Engine engine : engines)
+		{
+			char const* engine_name = chip8EngineName(engine);
+			if(engine == Chip8Engine::Static && !useStaticProgram(probe))
+			{
+				std::cout << "  " << engine_name << ": skipped, the linked program was recompiled from another ROM" << std::endl;
+				continue;
+			}
+			BenchmarkResult result;
+			if(!runCase(engine, rom, instructions, instructions_per_frame, repeats, result))
+			{
+				std::cerr << "  " << engine_name << ": the run didn't finish" << std::endl;
+				failures++;
+				continue;
+			}
+
+			double instructions_per_second = result.instructions / result.seconds;
+			double ns_per_instruction = result.seconds * 1e9 / result.instructions;
+			double frames_per_second = result.frames / result.seconds;
+
+			std::cout << "  " << engine_name << ": " << instructions_per_second / 1000000.0 << " M instructions/s, "
+				<< ns_per_instruction << " ns/instruction, " << frames_per_second << " frames/s, "
+				<< result.peak_rss_kb << " KB peak RSS" << std::endl;
+
+			char hash[17];
+			std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)result.display_hash);
+			output << "\"" << rom << "\"," << engine_name << "," << result.instructions << "," << result.frames << ","
+				<< result.seconds << "," << instructions_per_second << "," << ns_per_instruction << ","
+				<< frames_per_second << "," << result.peak_rss_kb << "," << hash << "\n";
+
+			auto base = baseline.find(rom + "," + engine_name);
+			if(baseline_name && base == baseline.end())
+			{
+				std::cout << "    not in the baseline" << std::endl;
+			}
+			else if(baseline_name)
+			{
+				double speed_change = (instructions_per_second / base->second.instructions_per_second - 1.0) * 100.0;
+				double rss_change = base->second.peak_rss_kb > 0 && result.peak_rss_kb > 0 ? ((double)result.peak_rss_kb / base->second.peak_rss_kb - 1.0) * 100.0 : 0;
+				if(speed_change < -threshold || rss_change > threshold)
+				{
+					std::cout << "    REGRESSION: " << speed_change << "% instructions/s, " << rss_change << "% peak RSS against the baseline" << std::endl;
+					regressions++;
+				}
+			}
+		}
+
+		if(lanes)
+		{
+			LaneResult result;
+			if(!runLanes(rom, instructions, instructions_per_frame, result))
+			{
+				std::cout << "  " << LOCKSTEP_LANES << " lanes: lockstep ended up different from the machines it was loaded from, not timed" << std::endl;
+				failures++;
+				continue;
+			}
+			std::cout << "  " << LOCKSTEP_LANES << " lanes scalar: " << (result.instance_steps / result.scalar_seconds) / 1000000.0 << " M instance-steps/s" << std::endl;
+			std::cout << "  " << LOCKSTEP_LANES << " lanes lockstep: " << (result.instance_steps / result.lockstep_seconds) / 1000000.0 << " M instance-steps/s"
+				<< " (" << result.scalar_seconds / result.lockstep_seconds << "x scalar, " << result.divergence * 100.0 << "% divergent steps)" << std::endl;
+		}
+	}
+
+	std::cout << "results in " << output_name << std::endl;
+	if(baseline_name)
+	{
+		std::cout << regressions << " regressions beyond " << threshold << "% against " << baseline_name << std::endl;
+	}
+	return regressions > 0 || failures > 0 ? 1 : 0;
+}
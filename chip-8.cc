@@ -1,15 +1,17 @@
 #include "chip-8.h"
+#include "jit.h"
+#include "romCache.h"
+#include <algorithm>
+#include <array>
 #include <chrono>
-#include <random>
+#include <cstring>
 #include <fstream>
 #include <functional>
 #include <iostream>
+#include <string>
 
-const unsigned int FONT_SET_SIZE = 80;
-const unsigned int FONT_START_ADDRESS = 0x050;
-const unsigned int ROM_START_ADDRESS = 0x200;
-
-uint8_t fontSet[FONT_SET_SIZE] =  
+//shared by every machine, copied into memory at FONT_START_ADDRESS
+static constexpr uint8_t fontSet[FONT_SET_SIZE] =
 	{
 		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
 		0x20, 0x60, 0x20, 0x20, 0x70, // 1
@@ -29,141 +31,729 @@ uint8_t fontSet[FONT_SET_SIZE] =
 		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 	};
 
+//SUPER-CHIP digits, copied into memory at BIG_FONT_START_ADDRESS
+static constexpr uint8_t bigFontSet[BIG_FONT_SET_SIZE] =
+	{
+		0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+		0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+		0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+		0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+		0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+		0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+		0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF  // 9
+	};
+
+//the dispatch tables are the same for every machine so they are built once at compile time.
+//slots without an instruction call op_null, which also covers every opcode the tables can be indexed with
+template<typename Quirks>
+constexpr std::array<typename BasicChip8<Quirks>::Chip8Function, 0xF + 1> BasicChip8<Quirks>::FunctionTable =
+{
+	&BasicChip8::table0, &BasicChip8::op_1nnn, &BasicChip8::op_2nnn, &BasicChip8::op_3xkk,
+	&BasicChip8::op_4xkk, &BasicChip8::op_5xy0, &BasicChip8::op_6xkk, &BasicChip8::op_7xkk,
+	&BasicChip8::table8, &BasicChip8::op_9xy0, &BasicChip8::op_Annn, &BasicChip8::op_Bnnn,
+	&BasicChip8::op_Cxkk, &BasicChip8::op_Dxyn, &BasicChip8::tableE, &BasicChip8::tableF
+};
+
+//indexed with the low byte so the SUPER-CHIP 00Cn and 00Fx instructions have their own slots.
+//without SUPER-CHIP only the low nibble counts, every 0nn0 clears the screen and every 0nnE returns
+template<typename Quirks>
+constexpr std::array<typename BasicChip8<Quirks>::Chip8Function, 0xFF + 1> BasicChip8<Quirks>::Table0 = []
+{
+	std::array<Chip8Function, 0xFF + 1> table{};
+	table.fill(&BasicChip8::op_null);
+	if constexpr(!Quirks::super_chip)
+	{
+		for(unsigned int kk = 0; kk <= 0xFF; kk += 0x10)
+		{
+			table[kk] = &BasicChip8::op_00E0;
+			table[kk + 0xE] = &BasicChip8::op_00EE;
+		}
+		return table;
+	}
+	table[0xE0] = &BasicChip8::op_00E0;
+	table[0xEE] = &BasicChip8::op_00EE;
+	for(unsigned int n = 0; n <= 0xF; n++)
+	{
+		table[0xC0 + n] = &BasicChip8::op_00Cn;
+	}
+	table[0xFB] = &BasicChip8::op_00FB;
+	table[0xFC] = &BasicChip8::op_00FC;
+	table[0xFE] = &BasicChip8::op_00FE;
+	table[0xFF] = &BasicChip8::op_00FF;
+	return table;
+}();
+
+template<typename Quirks>
+constexpr std::array<typename BasicChip8<Quirks>::Chip8Function, 0xF + 1> BasicChip8<Quirks>::Table8 = []
+{
+	std::array<Chip8Function, 0xF + 1> table{};
+	table.fill(&BasicChip8::op_null);
+	table[0x0] = &BasicChip8::op_8xy0;
+	table[0x1] = &BasicChip8::op_8xy1;
+	table[0x2] = &BasicChip8::op_8xy2;
+	table[0x3] = &BasicChip8::op_8xy3;
+	table[0x4] = &BasicChip8::op_8xy4;
+	table[0x5] = &BasicChip8::op_8xy5;
+	table[0x6] = &BasicChip8::op_8xy6;
+	table[0x7] = &BasicChip8::op_8xy7;
+	table[0xE] = &BasicChip8::op_8xyE;
+	return table;
+}();
+
+template<typename Quirks>
+constexpr std::array<typename BasicChip8<Quirks>::Chip8Function, 0xF + 1> BasicChip8<Quirks>::TableE = []
+{
+	std::array<Chip8Function, 0xF + 1> table{};
+	table.fill(&BasicChip8::op_null);
+	table[0x1] = &BasicChip8::op_ExA1;
+	table[0xE] = &BasicChip8::op_Ex9E;
+	return table;
+}();
+
+template<typename Quirks>
+constexpr std::array<typename BasicChip8<Quirks>::Chip8Function, 0xFF + 1> BasicChip8<Quirks>::TableF = []
+{
+	std::array<Chip8Function, 0xFF + 1> table{};
+	table.fill(&BasicChip8::op_null);
+	table[0x07] = &BasicChip8::op_Fx07;
+	table[0x0A] = &BasicChip8::op_Fx0A;
+	table[0x15] = &BasicChip8::op_Fx15;
+	table[0x18] = &BasicChip8::op_Fx18;
+	table[0x1E] = &BasicChip8::op_Fx1E;
+	table[0x29] = &BasicChip8::op_Fx29;
+	table[0x30] = &BasicChip8::op_Fx30;
+	table[0x33] = &BasicChip8::op_Fx33;
+	table[0x55] = &BasicChip8::op_Fx55;
+	table[0x65] = &BasicChip8::op_Fx65;
+	table[0x75] = &BasicChip8::op_Fx75;
+	table[0x85] = &BasicChip8::op_Fx85;
+	return table;
+}();
+
+unsigned int chip8InstructionsForFrame(uint32_t instructionsPerSecond, uint64_t frame)
+{
+	uint64_t second_frame = frame % TIMER_FREQUENCY;
+	return ((uint64_t)instructionsPerSecond * (second_frame + 1)) / TIMER_FREQUENCY - ((uint64_t)instructionsPerSecond * second_frame) / TIMER_FREQUENCY;
+}
+
+char const* chip8EngineName(Chip8Engine engine)
+{
+	switch(engine)
+	{
+		case Chip8Engine::Table: return "table";
+		case Chip8Engine::Switch: return "switch";
+		case Chip8Engine::Cached: return "cached";
+		case Chip8Engine::Jit: return "jit";
+		case Chip8Engine::Static: return "static";
+	}
+	return "unknown";
+}
+
+bool parseChip8Engine(char const* name, Chip8Engine& engine)
+{
+	for(Chip8Engine candidate : CHIP8_ENGINES)
+	{
+		if(std::strcmp(name, chip8EngineName(candidate)) == 0)
+		{
+			engine = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+char const* chip8QuirksName(Chip8Quirks quirks)
+{
+	switch(quirks)
+	{
+		case Chip8Quirks::Vip: return "vip";
+		case Chip8Quirks::Schip: return "schip";
+		case Chip8Quirks::Modern: return "modern";
+	}
+	return "unknown";
+}
+
+bool parseChip8Quirks(char const* name, Chip8Quirks& quirks)
+{
+	Chip8Quirks all[] = {Chip8Quirks::Vip, Chip8Quirks::Schip, Chip8Quirks::Modern};
+	for(Chip8Quirks candidate : all)
+	{
+		if(std::strcmp(name, chip8QuirksName(candidate)) == 0)
+		{
+			quirks = candidate;
+			return true;
+		}
+	}
+	return false;
+}
+
+Chip8Quirks chip8QuirksForRom(char const* filename)
+{
+	std::ifstream sidecar(std::string(filename) + ".quirks");
+	std::string name;
+	Chip8Quirks quirks;
+	if(sidecar >> name && parseChip8Quirks(name.c_str(), quirks))
+	{
+		return quirks;
+	}
+
+	char const* extension = std::strrchr(filename, '.');
+	if(extension != nullptr && std::strcmp(extension, ".sc8") == 0)
+	{
+		return Chip8Quirks::Schip;
+	}
+	return Chip8Quirks::Modern;
+}
+
+std::unique_ptr<Chip8Variant> createChip8(Chip8Quirks quirks, Chip8Engine engine)
+{
+	//machines can't be moved, so each alternative is constructed in place
+	switch(quirks)
+	{
+		case Chip8Quirks::Vip: return std::make_unique<Chip8Variant>(std::in_place_type<BasicChip8<VipQuirks>>, engine);
+		case Chip8Quirks::Schip: return std::make_unique<Chip8Variant>(std::in_place_type<BasicChip8<SchipQuirks>>, engine);
+		case Chip8Quirks::Modern: break;
+	}
+	return std::make_unique<Chip8Variant>(std::in_place_type<BasicChip8<ModernQuirks>>, engine);
+}
+
+//identifies snapshot files, followed by the version and the size of the snapshot
+const char SNAPSHOT_MAGIC[4] = {'C', '8', 'S', 'S'};
+
+bool writeChip8Snapshot(char const* filename, Chip8Snapshot const& snapshot)
+{
+	std::ofstream file(filename, std::ios_base::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	uint32_t version = CHIP8_SNAPSHOT_VERSION;
+	uint32_t size = sizeof(Chip8Snapshot);
+	file.write(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	file.write(reinterpret_cast<char const*>(&version), sizeof(version));
+	file.write(reinterpret_cast<char const*>(&size), sizeof(size));
+	file.write(reinterpret_cast<char const*>(&snapshot), sizeof(snapshot));
+	return file.good();
+}
+
+bool readChip8Snapshot(char const* filename, Chip8Snapshot& snapshot)
+{
+	std::ifstream file(filename, std::ios_base::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
 
+	char magic[sizeof(SNAPSHOT_MAGIC)];
+	uint32_t version = 0;
+	uint32_t size = 0;
+	file.read(magic, sizeof(magic));
+	file.read(reinterpret_cast<char*>(&version), sizeof(version));
+	file.read(reinterpret_cast<char*>(&size), sizeof(size));
+	if(!file.good() || std::memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0
+		|| version != CHIP8_SNAPSHOT_VERSION || size != sizeof(Chip8Snapshot))
+	{
+		return false;
+	}
 
-Chip8::Chip8()
-	:rng(std::chrono::system_clock::now().time_since_epoch().count())
+	//read into a copy so a truncated file leaves the caller's snapshot alone
+	Chip8Snapshot loaded;
+	file.read(reinterpret_cast<char*>(&loaded), sizeof(loaded));
+	if(file.gcount() != sizeof(loaded))
+	{
+		return false;
+	}
+
+	snapshot = loaded;
+	return true;
+}
+
+template<typename Quirks>
+BasicChip8<Quirks>::BasicChip8(Chip8Engine engine)
+	:engine(engine)
 {
-	random_byte = std::uniform_int_distribution<uint8_t>(0, 255U);	
+	//memory with the font loaded, cleared regesters, stack, timers, keypad and display, all in one copy
+	static_cast<Chip8State&>(*this) = powerOnImage().machine;
+
+	//unseeded machines still differ from run to run
+	seed(std::chrono::system_clock::now().time_since_epoch().count());
 
 	// initializes variables
-	pc = ROM_START_ADDRESS;
-	index_regester = 0;
-	stack_pointer = 0;
-	sound_timer = 0;
-	delay_timer = 0;
 	opcodes = 0;	
+	instruction_count = 0;
+	static_program = nullptr;
+	static_block_span = 0;
+	static_blocks_dropped = false;
+	draw_policy = Chip8DrawPolicy::Clip;
+	frame_generation = 0;
+	dirty_rows = 0;
+	idle_skipping = true;
+	skipped_instructions = 0;
+
+	op_00E0();	
 
-	for(int i = 0; i < NUM_REGESTERS; i++)
+	if(engine == Chip8Engine::Cached)
 	{
-		regesters[i] = 0;
+		//value-initialized so every slot starts out as OP_UNDECODED
+		decoded.reset(new Chip8Instruction[MEMORY_SIZE / 2]());
 	}
-	
-	op_00E0();	
-	//for(int i = 0; i < (DISPLAY_WIDTH * DISPLAY_HIGHT); i++)
-	//{
-	//	display[i] = 0;
-	//}	
-	//initialize function Tables
-	FunctionTable[0x0] = &Chip8::table0;
-	FunctionTable[0x1] = &Chip8::op_1nnn; 
-	FunctionTable[0x2] = &Chip8::op_2nnn;
-	FunctionTable[0x3] = &Chip8::op_3xkk;
-	FunctionTable[0x4] = &Chip8::op_4xkk;
-	FunctionTable[0x5] = &Chip8::op_5xy0;
-	FunctionTable[0x6] = &Chip8::op_6xkk;
-	FunctionTable[0x7] = &Chip8::op_7xkk;
-	FunctionTable[0x8] = &Chip8::table8;
-	FunctionTable[0x9] = &Chip8::op_9xy0;
-	FunctionTable[0xA] = &Chip8::op_Annn;
-	FunctionTable[0xB] = &Chip8::op_Bnnn;
-	FunctionTable[0xC] = &Chip8::op_Cxkk;
-	FunctionTable[0xD] = &Chip8::op_Dxyn;
-	FunctionTable[0xE] = &Chip8::tableE;
-	FunctionTable[0xF] = &Chip8::tableF;
-
-	for(int i = 0; i < 0xF; i++)
-	{
-		Table0[i] = &Chip8::op_null;
-		Table8[i] = &Chip8::op_null;
-		TableE[i] = &Chip8::op_null;
-	}		
-	Table0[0x0] = &Chip8::op_00E0;
-	Table0[0xE] = &Chip8::op_00EE;
-
-	Table8[0x0] = &Chip8::op_8xy0;
-	Table8[0x1] = &Chip8::op_8xy1;
-	Table8[0x2] = &Chip8::op_8xy2;
-	Table8[0x3] = &Chip8::op_8xy3;
-	Table8[0x4] = &Chip8::op_8xy4;
-	Table8[0x5] = &Chip8::op_8xy5;
-	Table8[0x6] = &Chip8::op_8xy6;
-	Table8[0x7] = &Chip8::op_8xy7;
-	Table8[0xE] = &Chip8::op_8xyE;
-
-	TableE[0x1] = &Chip8::op_ExA1;
-	TableE[0xE] = &Chip8::op_Ex9E;
-
-	for(int i = 0; i < 0x66; i++)
-	{
-		TableF[i] = &Chip8::op_null;
-	}
-	TableF[0x07] = &Chip8::op_Fx07;
-	TableF[0x0A] = &Chip8::op_Fx0A;
-	TableF[0x15] = &Chip8::op_Fx15;
-	TableF[0x18] = &Chip8::op_Fx18;
-	TableF[0x1E] = &Chip8::op_Fx1E;
-	TableF[0x29] = &Chip8::op_Fx29;
-	TableF[0x33] = &Chip8::op_Fx33;
-	TableF[0x55] = &Chip8::op_Fx55;
-	TableF[0x65] = &Chip8::op_Fx65;
-	
-	// Loads the font set into the RAM
-	for(unsigned int i = 0; i < FONT_SET_SIZE; i++)
+
+	if(engine == Chip8Engine::Jit)
 	{
-		memory[FONT_START_ADDRESS + i] = fontSet[i];
+		//the quirks are fixed per instantiation, so the JIT settles them when it translates a block
+		jit.reset(new Chip8Jit({Quirks::shift_uses_vy, Quirks::logic_resets_vf, Quirks::jump_uses_vx, Quirks::load_store_increments_index},
+			&BasicChip8::interpretForJit));
 	}
 	
 }
 
+template<typename Quirks>
+BasicChip8<Quirks>::~BasicChip8()
+{
+}
+
 //loads binary file data into the correct spot in memory
-void Chip8::loadROM(char const* filename)
-{
-	//creates an ifstream object tied to the given filename
-	//also specifies that the file is binary
-	std::ifstream rom_file(filename, std::ios_base::binary);
-		
-	if(rom_file.is_open())
-	{
-		//gets the length of the file and reads in data from file to a buffer;
-		rom_file.seekg(0, rom_file.end);
-		int length = rom_file.tellg();
-		rom_file.seekg(0, rom_file.beg);
-		char* buffer = new char[length];
-		rom_file.read(buffer, length);
-		rom_file.close();
-			
-		for(long i = 0; i < length; i++)
-		{
-			Chip8::memory[ROM_START_ADDRESS + i] = buffer[i];
+template<typename Quirks>
+bool BasicChip8<Quirks>::loadROM(char const* filename)
+{
+	//the file is mapped once and shared by every machine that loads it
+	std::span<const uint8_t> rom;
+	if(!Chip8RomCache::shared().get(filename, rom))
+	{
+		return false;
+	}
+	return loadROM(rom);
+}
+
+template<typename Quirks>
+bool BasicChip8<Quirks>::loadROM(std::span<const uint8_t> rom)
+{
+	//anything larger would run off the end of memory
+	if(rom.size() > MAX_ROM_SIZE)
+	{
+		return false;
+	}
+
+	std::memcpy(memory + ROM_START_ADDRESS, rom.data(), rom.size());
+	invalidateCode(ROM_START_ADDRESS, rom.size());
+
+	//the boot image is a freshly constructed machine with the ROM in place, whatever ran before the load
+	std::shared_ptr<Chip8Snapshot> image = std::make_shared<Chip8Snapshot>(powerOnImage());
+	std::memcpy(image->machine.memory + ROM_START_ADDRESS, rom.data(), rom.size());
+	boot_image = std::move(image);
+	return true;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::reset()
+{
+	uint64_t rng = rng_state;
+	loadState(boot_image ? *boot_image : powerOnImage());
+	rng_state = rng;
+	skipped_instructions = 0;
+}
+
+template<typename Quirks>
+std::shared_ptr<Chip8Snapshot const> BasicChip8<Quirks>::bootImage() const
+{
+	if(boot_image)
+	{
+		return boot_image;
+	}
+	return std::make_shared<Chip8Snapshot>(powerOnImage());
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::setBootImage(std::shared_ptr<Chip8Snapshot const> image)
+{
+	boot_image = std::move(image);
+	reset();
+}
+
+template<typename Quirks>
+Chip8Snapshot const& BasicChip8<Quirks>::powerOnImage()
+{
+	//what the constructor leaves behind, less the clock seeded random state
+	static Chip8Snapshot const image = []
+	{
+		Chip8Snapshot snapshot{};
+		std::memcpy(snapshot.machine.memory + FONT_START_ADDRESS, fontSet, FONT_SET_SIZE);
+		std::memcpy(snapshot.machine.memory + BIG_FONT_START_ADDRESS, bigFontSet, BIG_FONT_SET_SIZE);
+		snapshot.machine.pc = ROM_START_ADDRESS;
+		snapshot.machine.rng_state = chip8SeedRandom(0);
+		return snapshot;
+	}();
+	return image;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::cycle()
+{
+	tickTimers(step());
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::runFrame(unsigned int instructionsPerFrame)
+{
+	//compiled blocks never run past the end of the frame, JIT blocks stop early and recompiled ones are interpreted instead,
+	//so every engine ends the frame on the same instruction and replays line up
+	uint64_t frame_end = instruction_count + instructionsPerFrame;
+	while(instruction_count < frame_end)
+	{
+		uint16_t previous_pc = pc;
+		step(frame_end - instruction_count);
+
+		//wait loops always jump backwards, so only then is it worth looking for one
+		if(pc <= previous_pc && idle_skipping && instruction_count < frame_end)
+		{
+			skipIdleLoop(frame_end - instruction_count);
+		}
+	}
+
+	tickTimers(1);
+}
+
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::skipIdleLoop(uint64_t remaining)
+{
+	if(pc + 5U >= MEMORY_SIZE)
+	{
+		return 0;
+	}
+
+	Chip8Instruction head = decode((memory[pc] << 8U) | memory[pc + 1]);
+	unsigned int loop_length = 0;
+
+	if(head.handler == OP_1nnn && head.nnn == pc)
+	{
+		//a jump to itself, the usual way a ROM halts
+		loop_length = 1;
+	}
+	else if(head.handler == OP_Fx0A)
+	{
+		//op_Fx0A keeps rewinding until a key is down, and keys only change between frames
+		for(unsigned int i = 0; i < NUM_KEYS; i++)
+		{
+			if(keypad[i])
+			{
+				return 0;
+			}
+		}
+		loop_length = 1;
+	}
+	else if(head.handler == OP_Fx07)
+	{
+		//Fx07, 3xkk, 1nnn back to the Fx07 spins until the delay timer reaches kk,
+		//and the timer only ticks between frames
+		Chip8Instruction test = decode((memory[pc + 2] << 8U) | memory[pc + 3]);
+		Chip8Instruction jump = decode((memory[pc + 4] << 8U) | memory[pc + 5]);
+		if(test.handler != OP_3xkk || test.x != head.x || jump.handler != OP_1nnn || jump.nnn != pc || delayTimer() == test.kk)
+		{
+			return 0;
 		}
-			
-		delete[] buffer;
+		loop_length = 3;
+	}
+
+	if(loop_length == 0 || remaining < loop_length)
+	{
+		return 0;
+	}
+
+	//every whole iteration leaves the machine exactly as it found it, apart from Fx07 loading the timer,
+	//so they can all be skipped and the leftover partial iteration is stepped normally
+	uint64_t skipped = (remaining / loop_length) * loop_length;
+	if(head.handler == OP_Fx07)
+	{
+		regesters[head.x] = delayTimer();
 	}
+
+	instruction_count += skipped;
+	skipped_instructions += skipped;
+	return skipped;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::setIdleSkipping(bool enabled)
+{
+	idle_skipping = enabled;
+}
+
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::skippedInstructions() const
+{
+	return skipped_instructions;
 }
 
-void Chip8::cycle()
+template<typename Quirks>
+unsigned int BasicChip8<Quirks>::step(unsigned int limit)
 {		
-	//we left shift by 8 to make a 16byte adress (adds 8 zeros to the right of the starting value)
-	opcodes = (memory[pc] << 8U) | memory[pc + 1];
-	pc += 2;
-	
-	//this syntax is disgusting but essentialy we are dereferencing the memory address that contains the function we want to call
-	//then calling it from the chip8 object through this	
-	(this->*(FunctionTable[(opcodes & 0xF000U) >> 12U]))();		
-	
-	if(delay_timer > 0)
-	{	 
-		delay_timer -= 1;
-	}	
-	if(sound_timer > 0)
+	if(engine == Chip8Engine::Jit)
+	{
+		//compiled blocks set pc themselves and stop after limit instructions,
+		//a block that ended before an instruction the JIT leaves alone has that one interpreted by the next step
+		unsigned int executed = jit->run(*this, limit);
+		if(executed > 0)
+		{
+			instruction_count += executed;
+			return executed;
+		}
+	}
+
+	if(engine == Chip8Engine::Static && static_blocks && (pc & 0x1U) == 0 && static_blocks[pc >> 1U]
+		&& static_blocks[pc >> 1U]->length / 2U <= limit)
+	{
+		//recompiled blocks run their terminating jump, call, return or skip themselves and set pc
+		unsigned int executed = static_blocks[pc >> 1U]->code(*this);
+		instruction_count += executed;
+		return executed;
+	}
+
+	if(engine == Chip8Engine::Cached && (pc & 0x1U) == 0)
+	{
+		//decode lazily the first time an address is executed, afterwards skip fetch and decode entirely
+		Chip8Instruction& cached = decoded[pc >> 1U];
+		if(cached.handler == OP_UNDECODED)
+		{
+			cached = decode((memory[pc] << 8U) | memory[pc + 1]);
+		}
+		instruction = cached;
+		pc += 2;
+		dispatch(instruction.handler);
+	}
+	else
+	{
+		//we left shift by 8 to make a 16byte adress (adds 8 zeros to the right of the starting value)
+		opcodes = (memory[pc] << 8U) | memory[pc + 1];
+		pc += 2;
+
+		if(engine == Chip8Engine::Table)
+		{
+			instruction = decodeOperands(opcodes);
+
+			//this syntax is disgusting but essentialy we are dereferencing the memory address that contains the function we want to call
+			//then calling it from the chip8 object through this	
+			(this->*(FunctionTable[(opcodes & 0xF000U) >> 12U]))();		
+		}
+		else
+		{
+			//the Switch engine, the Jit and Static engines outside compiled blocks
+			//and the Cached engine when a jump lands on an odd address
+			instruction = decodeOperands(opcodes);
+			execute();
+		}
+	}
+
+	instruction_count++;
+	return 1;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::tickTimers(unsigned int ticks)
+{
+	timer_ticks += ticks;
+}
+
+template<typename Quirks>
+uint8_t BasicChip8<Quirks>::delayTimer() const
+{
+	uint64_t elapsed = timer_ticks - delay_timer_start;
+	return elapsed >= delay_timer ? 0 : delay_timer - elapsed;
+}
+
+template<typename Quirks>
+uint8_t BasicChip8<Quirks>::soundTimer() const
+{
+	uint64_t elapsed = timer_ticks - sound_timer_start;
+	return elapsed >= sound_timer ? 0 : sound_timer - elapsed;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::setDrawPolicy(Chip8DrawPolicy policy)
+{
+	draw_policy = policy;
+}
+
+template<typename Quirks>
+unsigned int BasicChip8<Quirks>::displayWidth() const
+{
+	return hires ? HIRES_DISPLAY_WIDTH : DISPLAY_WIDTH;
+}
+
+template<typename Quirks>
+unsigned int BasicChip8<Quirks>::displayHight() const
+{
+	return hires ? HIRES_DISPLAY_HIGHT : DISPLAY_HIGHT;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::renderRGBA(uint32_t* pixels, uint64_t rows) const
+{
+	unsigned int width = displayWidth();
+	for(unsigned int row = 0; row < displayHight(); row++)
 	{
-		sound_timer -= 1;	
+		if(!(rows & (1ULL << row)))
+		{
+			continue;
+		}
+
+		for(unsigned int column = 0; column < width; column++)
+		{
+			uint64_t pixle = display[row][column / 64U] & (0x8000000000000000ULL >> (column % 64U));
+			pixels[row * width + column] = pixle ? 0xFFFFFFFFU : 0;
+		}
 	}
+}
 
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::frameGeneration() const
+{
+	return frame_generation;
 }
 
-void Chip8::printState()
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::takeDirtyRows()
+{
+	uint64_t rows = dirty_rows;
+	dirty_rows = 0;
+	return rows;
+}
+
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::displayHash() const
+{
+	//only the words in use are hashed, so lo-res screens hash the same as they did before hi-res existed
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	unsigned int row_words = displayWidth() / 64U;
+	for(unsigned int row = 0; row < displayHight(); row++)
+	{
+		for(unsigned int word = 0; word < row_words; word++)
+		{
+			for(unsigned int byte = 0; byte < 8; byte++)
+			{
+				hash ^= (display[row][word] >> (56U - byte * 8U)) & 0xFFU;
+				hash *= 0x100000001B3ULL;
+			}
+		}
+	}
+	return hash;
+}
+
+template<typename Quirks>
+uint64_t BasicChip8<Quirks>::instructions() const
+{
+	return instruction_count;
+}
+
+template<typename Quirks>
+bool BasicChip8<Quirks>::useStaticProgram(Chip8StaticProgram const* program)
+{
+	//chip8-recompile translates every instruction the way ModernQuirks has it
+	if constexpr(!std::is_same_v<Quirks, ModernQuirks>)
+	{
+		return false;
+	}
+
+	if(ROM_START_ADDRESS + program->rom_size > MEMORY_SIZE
+		|| std::memcmp(&memory[ROM_START_ADDRESS], program->rom, program->rom_size) != 0)
+	{
+		return false;
+	}
+
+	static_blocks.reset(new Chip8StaticBlockEntry const*[MEMORY_SIZE / 2]());
+	static_program = program;
+	static_block_span = 0;
+	static_blocks_dropped = false;
+	for(unsigned int i = 0; i < program->block_count; i++)
+	{
+		static_blocks[program->blocks[i].address >> 1U] = &program->blocks[i];
+		static_block_span = std::max(static_block_span, program->blocks[i].length);
+	}
+
+	return true;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::restoreStaticBlocks()
+{
+	bool dropped = false;
+	for(unsigned int i = 0; i < static_program->block_count; i++)
+	{
+		Chip8StaticBlockEntry const& block = static_program->blocks[i];
+		if(static_blocks[block.address >> 1U] == &block)
+		{
+			continue;
+		}
+
+		//blocks are translated from the ROM alone, so its bytes are the code they were compiled from
+		unsigned int offset = block.address - ROM_START_ADDRESS;
+		if(block.address >= ROM_START_ADDRESS && offset + block.length <= static_program->rom_size
+			&& std::memcmp(&memory[block.address], &static_program->rom[offset], block.length) == 0)
+		{
+			static_blocks[block.address >> 1U] = &block;
+		}
+		else
+		{
+			dropped = true;
+		}
+	}
+	static_blocks_dropped = dropped;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::seed(uint64_t seed)
+{
+	rng_state = chip8SeedRandom(seed);
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::saveState(Chip8Snapshot& snapshot) const
+{
+	snapshot.machine = *this;
+	snapshot.instruction_count = instruction_count;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::loadState(Chip8Snapshot const& snapshot)
+{
+	//only the span of memory that actually differs has to be dropped from the decode and block caches,
+	//restoring within the same run usually leaves the code untouched
+	unsigned int first = 0;
+	unsigned int last = MEMORY_SIZE;
+	if(std::memcmp(memory, snapshot.machine.memory, MEMORY_SIZE) != 0)
+	{
+		while(memory[first] == snapshot.machine.memory[first])
+		{
+			first++;
+		}
+		while(memory[last - 1] == snapshot.machine.memory[last - 1])
+		{
+			last--;
+		}
+	}
+	else
+	{
+		last = first;
+	}
+
+	static_cast<Chip8State&>(*this) = snapshot.machine;
+	instruction_count = snapshot.instruction_count;
+
+	invalidateCode(first, last - first);
+	//reset and rewinding to before a self-modifying write bring the recompiled code back
+	if(static_blocks_dropped)
+	{
+		restoreStaticBlocks();
+	}
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::printState()
 {
 	std::cout << "CHIP-8 State" << std::endl;
 	std::cout << "Program Counter: " << pc << std::endl;
@@ -172,64 +762,505 @@ void Chip8::printState()
 	std::cout << std::endl;
 }
 
-void Chip8::table0()
+template<typename Quirks>
+Chip8Instruction BasicChip8<Quirks>::decodeOperands(uint16_t opcode)
+{
+	Chip8Instruction decoded_instruction;
+	decoded_instruction.handler = OP_UNDECODED;
+	decoded_instruction.x = (opcode & 0x0F00U) >> 8U;
+	decoded_instruction.y = (opcode & 0x00F0U) >> 4U;
+	decoded_instruction.n = opcode & 0x000FU;
+	decoded_instruction.kk = opcode & 0x00FFU;
+	decoded_instruction.nnn = opcode & 0x0FFFU;
+	return decoded_instruction;
+}
+
+template<typename Quirks>
+Chip8Instruction BasicChip8<Quirks>::decode(uint16_t opcode)
+{
+	Chip8Instruction decoded_instruction = decodeOperands(opcode);
+	uint8_t handler = OP_NULL;
+
+	//sub-opcodes are matched on the same bits the function tables index with so every engine behaves the same
+	switch((opcode & 0xF000U) >> 12U)
+	{
+		case 0x0:
+		{
+			if constexpr(!Quirks::super_chip)
+			{
+				switch(opcode & 0x000FU)
+				{
+					case 0x0: handler = OP_00E0; break;
+					case 0xE: handler = OP_00EE; break;
+				}
+				break;
+			}
+			switch(opcode & 0x00FFU)
+			{
+				case 0xE0: handler = OP_00E0; break;
+				case 0xEE: handler = OP_00EE; break;
+				case 0xFB: handler = OP_00FB; break;
+				case 0xFC: handler = OP_00FC; break;
+				case 0xFE: handler = OP_00FE; break;
+				case 0xFF: handler = OP_00FF; break;
+				default:
+				{
+					if((opcode & 0x00F0U) == 0xC0U)
+					{
+						handler = OP_00Cn;
+					}
+				}break;
+			}
+		}break;
+
+		case 0x1: handler = OP_1nnn; break;
+		case 0x2: handler = OP_2nnn; break;
+		case 0x3: handler = OP_3xkk; break;
+		case 0x4: handler = OP_4xkk; break;
+		case 0x5: handler = OP_5xy0; break;
+		case 0x6: handler = OP_6xkk; break;
+		case 0x7: handler = OP_7xkk; break;
+
+		case 0x8:
+		{
+			switch(opcode & 0x000FU)
+			{
+				case 0x0: handler = OP_8xy0; break;
+				case 0x1: handler = OP_8xy1; break;
+				case 0x2: handler = OP_8xy2; break;
+				case 0x3: handler = OP_8xy3; break;
+				case 0x4: handler = OP_8xy4; break;
+				case 0x5: handler = OP_8xy5; break;
+				case 0x6: handler = OP_8xy6; break;
+				case 0x7: handler = OP_8xy7; break;
+				case 0xE: handler = OP_8xyE; break;
+			}
+		}break;
+
+		case 0x9: handler = OP_9xy0; break;
+		case 0xA: handler = OP_Annn; break;
+		case 0xB: handler = OP_Bnnn; break;
+		case 0xC: handler = OP_Cxkk; break;
+		case 0xD: handler = OP_Dxyn; break;
+
+		case 0xE:
+		{
+			switch(opcode & 0x000FU)
+			{
+				case 0xE: handler = OP_Ex9E; break;
+				case 0x1: handler = OP_ExA1; break;
+			}
+		}break;
+
+		case 0xF:
+		{
+			switch(opcode & 0x00FFU)
+			{
+				case 0x07: handler = OP_Fx07; break;
+				case 0x0A: handler = OP_Fx0A; break;
+				case 0x15: handler = OP_Fx15; break;
+				case 0x18: handler = OP_Fx18; break;
+				case 0x1E: handler = OP_Fx1E; break;
+				case 0x29: handler = OP_Fx29; break;
+				case 0x30: handler = OP_Fx30; break;
+				case 0x33: handler = OP_Fx33; break;
+				case 0x55: handler = OP_Fx55; break;
+				case 0x65: handler = OP_Fx65; break;
+				case 0x75: handler = OP_Fx75; break;
+				case 0x85: handler = OP_Fx85; break;
+			}
+		}break;
+	}
+
+	decoded_instruction.handler = handler;
+	return decoded_instruction;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::execute()
+{
+	//every case calls a handler defined in this file so the compiler is free to inline it,
+	//unlike the pointer-to-member calls made through the function tables.
+	//Sub-opcodes are matched on the same bits the tables index with so both engines behave the same
+	switch((opcodes & 0xF000U) >> 12U)
+	{
+		case 0x0:
+		{
+			if constexpr(!Quirks::super_chip)
+			{
+				switch(opcodes & 0x000FU)
+				{
+					case 0x0: op_00E0(); break;
+					case 0xE: op_00EE(); break;
+					default: op_null(); break;
+				}
+				break;
+			}
+			switch(opcodes & 0x00FFU)
+			{
+				case 0xE0: op_00E0(); break;
+				case 0xEE: op_00EE(); break;
+				case 0xC0: case 0xC1: case 0xC2: case 0xC3: case 0xC4: case 0xC5: case 0xC6: case 0xC7:
+				case 0xC8: case 0xC9: case 0xCA: case 0xCB: case 0xCC: case 0xCD: case 0xCE: case 0xCF: op_00Cn(); break;
+				case 0xFB: op_00FB(); break;
+				case 0xFC: op_00FC(); break;
+				case 0xFE: op_00FE(); break;
+				case 0xFF: op_00FF(); break;
+				default: op_null(); break;
+			}
+		}break;
+
+		case 0x1: op_1nnn(); break;
+		case 0x2: op_2nnn(); break;
+		case 0x3: op_3xkk(); break;
+		case 0x4: op_4xkk(); break;
+		case 0x5: op_5xy0(); break;
+		case 0x6: op_6xkk(); break;
+		case 0x7: op_7xkk(); break;
+
+		case 0x8:
+		{
+			switch(opcodes & 0x000FU)
+			{
+				case 0x0: op_8xy0(); break;
+				case 0x1: op_8xy1(); break;
+				case 0x2: op_8xy2(); break;
+				case 0x3: op_8xy3(); break;
+				case 0x4: op_8xy4(); break;
+				case 0x5: op_8xy5(); break;
+				case 0x6: op_8xy6(); break;
+				case 0x7: op_8xy7(); break;
+				case 0xE: op_8xyE(); break;
+				default: op_null(); break;
+			}
+		}break;
+
+		case 0x9: op_9xy0(); break;
+		case 0xA: op_Annn(); break;
+		case 0xB: op_Bnnn(); break;
+		case 0xC: op_Cxkk(); break;
+		case 0xD: op_Dxyn(); break;
+
+		case 0xE:
+		{
+			switch(opcodes & 0x000FU)
+			{
+				case 0xE: op_Ex9E(); break;
+				case 0x1: op_ExA1(); break;
+				default: op_null(); break;
+			}
+		}break;
+
+		case 0xF:
+		{
+			switch(opcodes & 0x00FFU)
+			{
+				case 0x07: op_Fx07(); break;
+				case 0x0A: op_Fx0A(); break;
+				case 0x15: op_Fx15(); break;
+				case 0x18: op_Fx18(); break;
+				case 0x1E: op_Fx1E(); break;
+				case 0x29: op_Fx29(); break;
+				case 0x30: op_Fx30(); break;
+				case 0x33: op_Fx33(); break;
+				case 0x55: op_Fx55(); break;
+				case 0x65: op_Fx65(); break;
+				case 0x75: op_Fx75(); break;
+				case 0x85: op_Fx85(); break;
+				default: op_null(); break;
+			}
+		}break;
+	}
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::dispatch(uint8_t handler)
 {
-	(this->*(Table0[opcodes & 0x000FU]))();
+	switch(handler)
+	{
+		case OP_00E0: op_00E0(); break;
+		case OP_00EE: op_00EE(); break;
+		case OP_00Cn: op_00Cn(); break;
+		case OP_00FB: op_00FB(); break;
+		case OP_00FC: op_00FC(); break;
+		case OP_00FE: op_00FE(); break;
+		case OP_00FF: op_00FF(); break;
+		case OP_1nnn: op_1nnn(); break;
+		case OP_2nnn: op_2nnn(); break;
+		case OP_3xkk: op_3xkk(); break;
+		case OP_4xkk: op_4xkk(); break;
+		case OP_5xy0: op_5xy0(); break;
+		case OP_6xkk: op_6xkk(); break;
+		case OP_7xkk: op_7xkk(); break;
+		case OP_8xy0: op_8xy0(); break;
+		case OP_8xy1: op_8xy1(); break;
+		case OP_8xy2: op_8xy2(); break;
+		case OP_8xy3: op_8xy3(); break;
+		case OP_8xy4: op_8xy4(); break;
+		case OP_8xy5: op_8xy5(); break;
+		case OP_8xy6: op_8xy6(); break;
+		case OP_8xy7: op_8xy7(); break;
+		case OP_8xyE: op_8xyE(); break;
+		case OP_9xy0: op_9xy0(); break;
+		case OP_Annn: op_Annn(); break;
+		case OP_Bnnn: op_Bnnn(); break;
+		case OP_Cxkk: op_Cxkk(); break;
+		case OP_Dxyn: op_Dxyn(); break;
+		case OP_Ex9E: op_Ex9E(); break;
+		case OP_ExA1: op_ExA1(); break;
+		case OP_Fx07: op_Fx07(); break;
+		case OP_Fx0A: op_Fx0A(); break;
+		case OP_Fx15: op_Fx15(); break;
+		case OP_Fx18: op_Fx18(); break;
+		case OP_Fx1E: op_Fx1E(); break;
+		case OP_Fx29: op_Fx29(); break;
+		case OP_Fx30: op_Fx30(); break;
+		case OP_Fx33: op_Fx33(); break;
+		case OP_Fx55: op_Fx55(); break;
+		case OP_Fx65: op_Fx65(); break;
+		case OP_Fx75: op_Fx75(); break;
+		case OP_Fx85: op_Fx85(); break;
+		default: op_null(); break;
+	}
 }
 
-void Chip8::table8()
+template<typename Quirks>
+void BasicChip8<Quirks>::interpretForJit(Chip8State& state, uint16_t opcode)
+{
+	//blocks only hand over instructions that leave pc alone or end the block, like Dxyn and Fx0A
+	BasicChip8& machine = static_cast<BasicChip8&>(state);
+	machine.opcodes = opcode;
+	machine.instruction = decode(opcode);
+	machine.dispatch(machine.instruction.handler);
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::invalidateCode(uint16_t address, uint16_t length)
+{
+	if(jit)
+	{
+		jit->invalidate(address, length);
+	}
+
+	if(static_blocks && length > 0)
+	{
+		//self-modified blocks are dropped and their code is interpreted until loadState finds it restored.
+		//only the slots of blocks that can reach the write are checked, not every block of the program
+		unsigned int first = (address > static_block_span ? address - static_block_span : 0) >> 1U;
+		unsigned int last = std::min<unsigned int>((address + length - 1U) >> 1U, MEMORY_SIZE / 2 - 1);
+		for(unsigned int slot = first; slot <= last; slot++)
+		{
+			Chip8StaticBlockEntry const* block = static_blocks[slot];
+			if(block && block->address < address + length && block->address + block->length > address)
+			{
+				static_blocks[slot] = nullptr;
+				static_blocks_dropped = true;
+			}
+		}
+	}
+
+	if(!decoded || length == 0)
+	{
+		return;
+	}
+
+	//a write to either byte of an instruction invalidates its slot
+	unsigned int first = address >> 1U;
+	unsigned int last = (address + length - 1U) >> 1U;
+	if(last >= MEMORY_SIZE / 2)
+	{
+		last = MEMORY_SIZE / 2 - 1;
+	}
+
+	for(unsigned int slot = first; slot <= last; slot++)
+	{
+		decoded[slot].handler = OP_UNDECODED;
+	}
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::setResolution(bool high)
+{
+	hires = high;
+	std::memset(display, 0, sizeof(display));
+
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::table0()
+{
+	(this->*(Table0[opcodes & 0x00FFU]))();
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::table8()
 {
 	(this->*(Table8[opcodes & 0x000FU]))();	
 }
 
-void Chip8::tableE()
+template<typename Quirks>
+void BasicChip8<Quirks>::tableE()
 {
 	(this->*(TableE[opcodes & 0x000FU]))();
 }
 
-void Chip8::tableF()
+template<typename Quirks>
+void BasicChip8<Quirks>::tableF()
 {
 	(this->*(TableF[opcodes & 0x00FFU]))();
 }
 
-void Chip8::op_null()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_null()
 {
 
 }
 
 //CLS clears the display
-void Chip8::op_00E0()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00E0()
 {
-	std::memset(display, 0, sizeof(display));
+	if(hires)
+	{
+		std::memset(display, 0, sizeof(display));
+	}
+	else
+	{
+		//the rest of the display is always clear in lo-res, only the words in use need clearing
+		for(unsigned int row = 0; row < DISPLAY_HIGHT; row++)
+		{
+			display[row][0] = 0;
+		}
+	}
+
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
 }
 
 //RET returns from a subroutine
-void Chip8::op_00EE()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00EE()
 {
 	--stack_pointer;
 	pc = stack[stack_pointer];
 }
 
+//SCD n scroll the display down n rows
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00Cn()
+{
+	if constexpr(!Quirks::super_chip)
+	{
+		return;
+	}
+
+	unsigned int rows = instruction.n;
+	unsigned int hight = displayHight();
+	if(rows == 0)
+	{
+		return;
+	}
+
+	//rows are whole entries, so scrolling moves them in one go and clears the ones left at the top
+	std::memmove(display[rows], display[0], (hight - rows) * sizeof(display[0]));
+	std::memset(display[0], 0, rows * sizeof(display[0]));
+
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
+}
+
+//SCR scroll the display right 4 pixels
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00FB()
+{
+	if constexpr(!Quirks::super_chip)
+	{
+		return;
+	}
+
+	unsigned int row_words = displayWidth() / 64U;
+	for(unsigned int row = 0; row < displayHight(); row++)
+	{
+		//pixels shifted out of a word move into the left of the next one
+		for(unsigned int word = row_words - 1; word > 0; word--)
+		{
+			display[row][word] = (display[row][word] >> 4U) | (display[row][word - 1] << 60U);
+		}
+		display[row][0] >>= 4U;
+	}
+
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
+}
+
+//SCL scroll the display left 4 pixels
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00FC()
+{
+	if constexpr(!Quirks::super_chip)
+	{
+		return;
+	}
+
+	unsigned int row_words = displayWidth() / 64U;
+	for(unsigned int row = 0; row < displayHight(); row++)
+	{
+		for(unsigned int word = 0; word + 1 < row_words; word++)
+		{
+			display[row][word] = (display[row][word] << 4U) | (display[row][word + 1] >> 60U);
+		}
+		display[row][row_words - 1] <<= 4U;
+	}
+
+	dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	frame_generation++;
+}
+
+//LOW switch to the 64x32 display
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00FE()
+{
+	if constexpr(Quirks::super_chip)
+	{
+		setResolution(false);
+	}
+}
+
+//HIGH switch to the 128x64 display
+template<typename Quirks>
+void BasicChip8<Quirks>::op_00FF()
+{
+	if constexpr(Quirks::super_chip)
+	{
+		setResolution(true);
+	}
+}
+
 //JP jump to location nnn
-void Chip8::op_1nnn()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_1nnn()
 {
-	pc = opcodes & 0x0FFFU; 
+	pc = instruction.nnn; 
 }
 
 //CALL
-void Chip8::op_2nnn()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_2nnn()
 {	
-	uint16_t address = opcodes & 0x0FFFU;
+	uint16_t address = instruction.nnn;
 	stack[stack_pointer] = pc;
 	++stack_pointer;
 	pc = address;
 	
 }
 
-void Chip8::op_3xkk()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_3xkk()
 {
-	uint8_t compared_value = opcodes & 0x00FFU;
-	uint8_t Vx = (opcodes & 0x0F00U)>> 8U;
+	uint8_t compared_value = instruction.kk;
+	uint8_t Vx = instruction.x;
 	
 	if(compared_value == regesters[Vx])
 	{
@@ -237,10 +1268,11 @@ void Chip8::op_3xkk()
 	}	
 }
 
-void Chip8::op_4xkk()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_4xkk()
 {
-	uint8_t compared_value = opcodes & 0x00FFU;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t compared_value = instruction.kk;
+	uint8_t Vx = instruction.x;
 	
 	if(compared_value != regesters[Vx])
 	{
@@ -248,10 +1280,11 @@ void Chip8::op_4xkk()
 	}
 }
 
-void Chip8::op_5xy0()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_5xy0()
 {
-	uint8_t Vy = (opcodes & 0x00F0) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 	
 	if(regesters[Vx] == regesters[Vy])
 	{
@@ -259,57 +1292,82 @@ void Chip8::op_5xy0()
 	}
 }
 
-void Chip8::op_6xkk()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_6xkk()
 {
-	uint8_t load_value = opcodes & 0x00FFU;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t load_value = instruction.kk;
+	uint8_t Vx = instruction.x;
 	regesters[Vx] = load_value;
 }
 
-void Chip8::op_7xkk()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_7xkk()
 {
-	uint8_t byte = opcodes & 0x00FFU;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t byte = instruction.kk;
+	uint8_t Vx = instruction.x;
 	regesters[Vx] += byte;
 }
 
-void Chip8::op_8xy0()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy0()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 	regesters[Vx] = regesters[Vy];
 }
 
-void Chip8::op_8xy1()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy1()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 	
 	regesters[Vx] = (regesters[Vx] | regesters[Vy]);
+
+	if constexpr(Quirks::logic_resets_vf)
+	{
+		regesters[0xF] = 0;
+	}
 }
 
-void Chip8::op_8xy2()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy2()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 	
 	regesters[Vx] = (regesters[Vx] & regesters[Vy]);
+
+	if constexpr(Quirks::logic_resets_vf)
+	{
+		regesters[0xF] = 0;
+	}
 }
 
-void Chip8::op_8xy3()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy3()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 	regesters[Vx] = (regesters[Vx] ^ regesters[Vy]);
+
+	if constexpr(Quirks::logic_resets_vf)
+	{
+		regesters[0xF] = 0;
+	}
 }
 
-void Chip8::op_8xy4()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy4()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 
-	uint8_t sum = regesters[Vx] + regesters[Vy];
-	if(sum > 255U)
+	unsigned int sum = regesters[Vx] + regesters[Vy];
+	regesters[Vx] = sum & 0x00FFU;
+
+	//the carry goes in last so it wins when Vx is VF
+	if(sum > 0xFFU)
 	{
 		regesters[0xF] = 1;
 	}
@@ -317,14 +1375,13 @@ void Chip8::op_8xy4()
 	{
 		regesters[0xF] = 0;
 	}
-	
-	regesters[Vx] = sum & 0x00FFU;
 }
 
-void Chip8::op_8xy5()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy5()
 {
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vy = instruction.y;
+	uint8_t Vx = instruction.x;
 
 	uint8_t difference = regesters[Vx] - regesters[Vy];
 	if(regesters[Vx] > regesters[Vy])
@@ -339,20 +1396,28 @@ void Chip8::op_8xy5()
 	regesters[Vx] = difference;
 }
 
-void Chip8::op_8xy6()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy6()
 {	
-	//if the last bit of value stored in Vx is 1 set Vf to 1 else set to 0
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	regesters[0xF] = regesters[Vx] & 0x1U;
+	uint8_t Vx = instruction.x;
+	uint8_t source = Vx;
+	if constexpr(Quirks::shift_uses_vy)
+	{
+		source = instruction.y;
+	}
+
+	//if the last bit of value stored in the source is 1 set Vf to 1 else set to 0
+	regesters[0xF] = regesters[source] & 0x1U;
 	
-	//divide regester Vx by 2
-	regesters[Vx] = regesters[Vx] >> 1U;
+	//divide the source by 2 into Vx
+	regesters[Vx] = regesters[source] >> 1U;
 }
 
-void Chip8::op_8xy7()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xy7()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 
 	if(regesters[Vy] > regesters[Vx])
 	{
@@ -366,20 +1431,26 @@ void Chip8::op_8xy7()
 	regesters[Vx] = regesters[Vy] - regesters[Vx]; 	
 }
 
-void Chip8::op_8xyE()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_8xyE()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
+	uint8_t Vx = instruction.x;
+	uint8_t source = Vx;
+	if constexpr(Quirks::shift_uses_vy)
+	{
+		source = instruction.y;
+	}
 	
-	regesters[0xF] = (regesters[Vx] & 0x80U) >> 7U;
+	regesters[0xF] = (regesters[source] & 0x80U) >> 7U;
 	
-	regesters[Vx] = regesters[Vx] << 1U;
+	regesters[Vx] = regesters[source] << 1U;
 }
 
-void Chip8::op_9xy0()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_9xy0()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
 	
 	if(regesters[Vx] != regesters[Vy])
 	{
@@ -388,69 +1459,146 @@ void Chip8::op_9xy0()
 
 }
 
-void Chip8::op_Annn()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Annn()
 {
-	uint16_t address = opcodes & 0x0FFFU;
+	uint16_t address = instruction.nnn;
 	index_regester = address;
 }
 
-void Chip8::op_Bnnn()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Bnnn()
 {
-	uint16_t address = opcodes & 0x0FFFU;
-	pc = address + regesters[0];
+	uint16_t address = instruction.nnn;
+	if constexpr(Quirks::jump_uses_vx)
+	{
+		//Bxnn, the high nibble of the address picks the regester
+		pc = address + regesters[instruction.x];
+	}
+	else
+	{
+		pc = address + regesters[0];
+	}
 }
 
-void Chip8::op_Cxkk()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Cxkk()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	uint8_t byte = opcodes & 0x00FFU;
+	uint8_t Vx = instruction.x;
+	uint8_t byte = instruction.kk;
 	
-	regesters[Vx] = random_byte(rng) & byte;	
+	regesters[Vx] = chip8RandomByte(rng_state) & byte;	
 }
 
-void Chip8::op_Dxyn()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Dxyn()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	uint8_t Vy = (opcodes & 0x00F0U) >> 4U;
-	uint8_t height = opcodes & 0x000FU;
-	
-	//We modulo to wrap around if the coordinates are too large
-	uint8_t x_coordinate = regesters[Vx] % DISPLAY_WIDTH;
-	uint8_t y_coordinate = regesters[Vy] % DISPLAY_HIGHT;
+	//SUPER-CHIP draws a 16x16 sprite for Dxy0, two bytes to a row
+	if constexpr(Quirks::super_chip)
+	{
+		if(instruction.n == 0)
+		{
+			drawSprite<16>(16);
+			return;
+		}
+	}
+
+	drawSprite<8>(instruction.n);
+}
+
+template<typename Quirks>
+template<unsigned int SpriteWidth>
+void BasicChip8<Quirks>::drawSprite(unsigned int height)
+{
+	uint8_t Vx = instruction.x;
+	uint8_t Vy = instruction.y;
+	unsigned int row_bytes = SpriteWidth / 8U;
+
+	unsigned int display_width = displayWidth();
+	unsigned int display_hight = displayHight();
+
+	//We modulo to wrap around if the coordinates are too large, both sizes are powers of two so it's a mask rather than a divide
+	unsigned int x_coordinate = regesters[Vx] & (display_width - 1U);
+	unsigned int y_coordinate = regesters[Vy] & (display_hight - 1U);
+
+	//a sprite row lands in the word holding x_coordinate, and whatever is pushed past the right of that word
+	//spills into the next one, or with Wrap back into the first word once it runs off the right edge
+	unsigned int word = x_coordinate / 64U;
+	unsigned int shift = x_coordinate % 64U;
+	unsigned int spill_word = word + 1;
+	bool spill = shift > 0;
+	if(spill_word * 64U == display_width)
+	{
+		spill_word = 0;
+		spill = spill && draw_policy == Chip8DrawPolicy::Wrap;
+	}
 
 	//Address in memory where the sprite starts
 	uint16_t sprite_address = index_regester;
 	
 	//set flag to zero (might be modified later
 	regesters[0xF] = 0;
+
+	//only rows the sprite actually flips count as changed
+	bool changed = false;
 	
 	for(unsigned int row = 0; row < height; row++)
 	{
-		//gets the byte we want to draw to the screen
-		uint8_t sprite_byte = memory[sprite_address + row];
+		unsigned int screen_row = y_coordinate + row;
+		if(screen_row >= display_hight)
+		{
+			if(draw_policy == Chip8DrawPolicy::Clip)
+			{
+				break;
+			}
+			screen_row -= display_hight;
+		}
 
-		for(unsigned int pixle = 0; pixle < 8; pixle++)
+		//gets the row of the sprite we want to draw to the screen, lined up against the left of a word
+		uint64_t sprite_bits = 0;
+		for(unsigned int byte = 0; byte < row_bytes; byte++)
 		{
-			uint8_t sprite_pixle = sprite_byte & (0x80U >> pixle);
-			uint32_t* screen_pixle = &display[(y_coordinate + row) * DISPLAY_WIDTH + (x_coordinate + pixle)];
-			
-			if(sprite_pixle != 0)
+			sprite_bits |= (uint64_t)memory[sprite_address + row * row_bytes + byte] << (56U - byte * 8U);
+		}
+
+		uint64_t* screen = display[screen_row];
+		uint64_t sprite_row = sprite_bits >> shift;
+		uint64_t spilled = 0;
+		if(spill)
+		{
+			spilled = sprite_bits << (64U - shift);
+			if(screen[spill_word] & spilled)
 			{
-				// set flag to one if there was a collision
-				if(*screen_pixle)
-				{
-					regesters[0xF] = 1;
-				}
-				
-				*screen_pixle ^= 0xFFFFFFFFU;
-			}	
+				regesters[0xF] = 1;
+			}
+			screen[spill_word] ^= spilled;
+		}
+
+		// set flag to one if there was a collision
+		if(screen[word] & sprite_row)
+		{
+			regesters[0xF] = 1;
+		}
+
+		screen[word] ^= sprite_row;
+
+		if(sprite_row | spilled)
+		{
+			dirty_rows |= 1ULL << screen_row;
+			changed = true;
 		}
 	}	
+
+	if(changed)
+	{
+		frame_generation++;
+	}
 }
 
-void Chip8::op_Ex9E()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Ex9E()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	uint8_t key = regesters[Vx];
 
 	if(keypad[key])
@@ -459,9 +1607,10 @@ void Chip8::op_Ex9E()
 	}
 }
 
-void Chip8::op_ExA1()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_ExA1()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	uint8_t key = regesters[Vx];
 	
 	if(!keypad[key])
@@ -470,15 +1619,17 @@ void Chip8::op_ExA1()
 	}
 }
 
-void Chip8::op_Fx07()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx07()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
-	regesters[Vx] = delay_timer;
+	uint8_t Vx = instruction.x;
+	regesters[Vx] = delayTimer();
 }
 
-void Chip8::op_Fx0A()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx0A()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	
 	for(int i = 0x0U; i <= 0xF; i++)
 	{
@@ -492,56 +1643,120 @@ void Chip8::op_Fx0A()
 	pc -= 2;	
 }
 
-void Chip8::op_Fx15()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx15()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	delay_timer = regesters[Vx];
+	delay_timer_start = timer_ticks;
 
 }
 
-void Chip8::op_Fx18()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx18()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	sound_timer = regesters[Vx];
+	sound_timer_start = timer_ticks;
 
 }
 
-void Chip8::op_Fx1E()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx1E()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	index_regester = index_regester + regesters[Vx];
 }
 
 //LD F, Vx Set I equal to the location of sprite for digit Vx
-void Chip8::op_Fx29()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx29()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	uint8_t digit = regesters[Vx];
 	index_regester = FONT_START_ADDRESS + (digit * 5);
 }
 
-void Chip8::op_Fx33()
+//LD HF, Vx Set I equal to the location of the big font sprite for digit Vx
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx30()
+{
+	if constexpr(Quirks::super_chip)
+	{
+		uint8_t digit = regesters[instruction.x];
+		index_regester = BIG_FONT_START_ADDRESS + (digit * 10);
+	}
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx33()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	memory[index_regester + 2] = regesters[Vx] % 10;
 	memory[index_regester + 1] = (regesters[Vx] / 10) % 10;
 	memory[index_regester] = (regesters[Vx] / 100) % 10;	
+
+	invalidateCode(index_regester, 3);
 }
 
-void Chip8::op_Fx55()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx55()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	for(uint8_t i = 0; i <= Vx; i++)
 	{
 		memory[index_regester + i] = regesters[i];
 	}
+
+	invalidateCode(index_regester, Vx + 1);
+
+	if constexpr(Quirks::load_store_increments_index)
+	{
+		index_regester += Vx + 1;
+	}
 }
 
-void Chip8::op_Fx65()
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx65()
 {
-	uint8_t Vx = (opcodes & 0x0F00U) >> 8U;
+	uint8_t Vx = instruction.x;
 	for(uint8_t i = 0; i <= Vx; i++)
 	{
 		regesters[i] = memory[index_regester + i];
 	}
+
+	if constexpr(Quirks::load_store_increments_index)
+	{
+		index_regester += Vx + 1;
+	}
 }
+
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx75()
+{
+	if constexpr(Quirks::super_chip)
+	{
+		uint8_t Vx = instruction.x;
+		for(uint8_t i = 0; i <= Vx; i++)
+		{
+			flag_regesters[i] = regesters[i];
+		}
+	}
+}
+
+template<typename Quirks>
+void BasicChip8<Quirks>::op_Fx85()
+{
+	if constexpr(Quirks::super_chip)
+	{
+		uint8_t Vx = instruction.x;
+		for(uint8_t i = 0; i <= Vx; i++)
+		{
+			regesters[i] = flag_regesters[i];
+		}
+	}
+}
+
+template class BasicChip8<VipQuirks>;
+template class BasicChip8<SchipQuirks>;
+template class BasicChip8<ModernQuirks>;
@@ -1,7 +1,11 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
-#include <random>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <variant>
 
 //CONSTANTS
 const unsigned int MEMORY_SIZE = 4096;
@@ -10,22 +14,345 @@ const unsigned int STACK_SIZE = 16;
 const unsigned int NUM_KEYS = 16;
 const unsigned int DISPLAY_HIGHT = 32;
 const unsigned int DISPLAY_WIDTH = 64;
+//SUPER-CHIP high resolution, switched to with 00FF and back with 00FE
+const unsigned int HIRES_DISPLAY_HIGHT = 64;
+const unsigned int HIRES_DISPLAY_WIDTH = 128;
+//64 pixle words per display row, enough for a hi-res row
+const unsigned int DISPLAY_ROW_WORDS = HIRES_DISPLAY_WIDTH / 64;
+const unsigned int FONT_SET_SIZE = 80;
+const unsigned int FONT_START_ADDRESS = 0x050;
+//SUPER-CHIP 8x10 digits for Fx30, right after the small font
+const unsigned int BIG_FONT_SET_SIZE = 100;
+const unsigned int BIG_FONT_START_ADDRESS = FONT_START_ADDRESS + FONT_SET_SIZE;
+//Fx75 and Fx85 save V0 - Vx here. SUPER-CHIP only promises V0 - V7, room is kept for all 16 like later interpreters
+const unsigned int NUM_FLAG_REGESTERS = 16;
+const unsigned int ROM_START_ADDRESS = 0x200;
+const unsigned int MAX_ROM_SIZE = MEMORY_SIZE - ROM_START_ADDRESS;
+const unsigned int TIMER_FREQUENCY = 60;
+
+//Execution engines a Chip8 can be constructed with
+enum class Chip8Engine
+{
+	//dispatches through the pointer-to-member function tables
+	Table,
+	//decodes with one flat switch so the op_* handlers can be inlined
+	Switch,
+	//like Switch but keeps every decoded instruction in a cache parallel to memory
+	Cached,
+	//compiles basic blocks to x86-64 that call back into the interpreter for drawing and the SUPER-CHIP instructions, interprets the rest like Switch
+	Jit,
+	//runs blocks of a ROM translated ahead of time by chip8-recompile, interprets everything else like Switch
+	Static
+};
+
+//every engine in declaration order, for tools that go through all of them
+const Chip8Engine CHIP8_ENGINES[] = {Chip8Engine::Table, Chip8Engine::Switch, Chip8Engine::Cached, Chip8Engine::Jit, Chip8Engine::Static};
+
+//instructions to run in the given frame so instructionsPerSecond is spread over the TIMER_FREQUENCY frames
+//of each second without dropping the remainder
+unsigned int chip8InstructionsForFrame(uint32_t instructionsPerSecond, uint64_t frame);
+
+//lower case engine names used on the command line of the tools
+char const* chip8EngineName(Chip8Engine engine);
+//returns false if name is not one of the engine names
+bool parseChip8Engine(char const* name, Chip8Engine& engine);
+
+class Chip8Jit;
+
+//What op_Dxyn does with the parts of a sprite that go past the right or bottom edge
+enum class Chip8DrawPolicy
+{
+	Clip,
+	Wrap
+};
+
+//Handler indices produced by the decoder, one per op_* function
+enum Chip8Opcode : uint8_t
+{
+	OP_UNDECODED = 0, //marks an empty slot in the decoded instruction cache
+	OP_NULL,
+	OP_00E0, OP_00EE, OP_00Cn, OP_00FB, OP_00FC, OP_00FE, OP_00FF,
+	OP_1nnn, OP_2nnn, OP_3xkk, OP_4xkk, OP_5xy0, OP_6xkk, OP_7xkk,
+	OP_8xy0, OP_8xy1, OP_8xy2, OP_8xy3, OP_8xy4, OP_8xy5, OP_8xy6, OP_8xy7, OP_8xyE,
+	OP_9xy0, OP_Annn, OP_Bnnn, OP_Cxkk, OP_Dxyn,
+	OP_Ex9E, OP_ExA1,
+	OP_Fx07, OP_Fx0A, OP_Fx15, OP_Fx18, OP_Fx1E, OP_Fx29, OP_Fx30, OP_Fx33, OP_Fx55, OP_Fx65, OP_Fx75, OP_Fx85
+};
+
+//An opcode split into its handler index and pre-extracted operands
+struct Chip8Instruction
+{
+	uint8_t handler;
+	uint8_t x;
+	uint8_t y;
+	uint8_t n;
+	uint8_t kk;
+	uint16_t nnn;
+};
+
+//Machine state of a Chip8. Recompiled code generated by chip8-recompile operates on it directly
+struct Chip8State
+{
+	uint8_t memory[MEMORY_SIZE];
+	uint8_t regesters[NUM_REGESTERS];	
+	uint16_t pc;
+	uint16_t index_regester;
+	uint16_t stack[STACK_SIZE];
+	uint8_t stack_pointer;
+
+	//the timers hold the value they were last set to and the tick they were set on,
+	//their current value is worked out from timer_ticks only when something reads it
+	uint8_t sound_timer;
+	uint8_t delay_timer;
+	uint64_t sound_timer_start;
+	uint64_t delay_timer_start;
+	uint64_t timer_ticks;
+
+	uint8_t keypad[NUM_KEYS];
+	//one row per entry, the most significant bit of the first word is the leftmost pixel.
+	//lo-res only uses the first word of the first DISPLAY_HIGHT rows, everything else stays clear
+	uint64_t display[HIRES_DISPLAY_HIGHT][DISPLAY_ROW_WORDS];
+	//set by 00FF and cleared by 00FE
+	uint8_t hires;
+	//saved and restored by Fx75 and Fx85
+	uint8_t flag_regesters[NUM_FLAG_REGESTERS];
+
+	//xorshift64* state for op_Cxkk, never 0
+	uint64_t rng_state;
+};
+
+//turns any seed into a usable rng_state, spreading the bits with splitmix64 so nearby seeds give unrelated sequences
+inline uint64_t chip8SeedRandom(uint64_t seed)
+{
+	uint64_t z = seed + 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30U)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27U)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31U);
+	return z != 0 ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+//advances a xorshift64* state and returns the top byte of the output, the same on every compiler
+inline uint8_t chip8RandomByte(uint64_t& state)
+{
+	state ^= state >> 12U;
+	state ^= state << 25U;
+	state ^= state >> 27U;
+	return (state * 0x2545F4914F6CDD1DULL) >> 56U;
+}
+
+//bumped whenever the layout of Chip8Snapshot changes, older snapshot files are rejected
+const uint32_t CHIP8_SNAPSHOT_VERSION = 3;
+
+//Everything needed to resume a Chip8 exactly where it left off.
+//Plain data, so saving and restoring is a single copy and a file is just the raw bytes behind a header
+struct Chip8Snapshot
+{
+	Chip8State machine;
+	uint64_t instruction_count;
+};
+static_assert(std::is_trivially_copyable<Chip8Snapshot>::value, "snapshots are copied and written as raw bytes");
+
+//snapshot files are a header followed by the Chip8Snapshot in host byte order.
+//both return false if the file can't be opened or, when reading, isn't a snapshot of this version
+bool writeChip8Snapshot(char const* filename, Chip8Snapshot const& snapshot);
+bool readChip8Snapshot(char const* filename, Chip8Snapshot& snapshot);
+
+//A recompiled basic block, returns the number of instructions it executed.
+//Blocks always leave pc pointing at the next instruction to run
+typedef unsigned int (*Chip8StaticBlock)(Chip8State& state);
+
+struct Chip8StaticBlockEntry
+{
+	uint16_t address;
+	uint16_t length; //bytes of code the block was translated from
+	Chip8StaticBlock code;
+};
+
+//A ROM translated ahead of time by chip8-recompile
+struct Chip8StaticProgram
+{
+	uint8_t const* rom;
+	uint16_t rom_size;
+	Chip8StaticBlockEntry const* blocks;
+	uint16_t block_count;
+};
+
+//The quirk sets as a value, for picking an instantiation at run time
+enum class Chip8Quirks
+{
+	Vip,
+	Schip,
+	Modern
+};
+
+//Instructions CHIP-8 interpreters disagree on. A BasicChip8 takes one of these as its template parameter,
+//so every instantiation has its behaviour compiled in and the handlers never check a quirk at run time
+struct VipQuirks
+{
+	//the value createChip8 takes for this set, and what movies record
+	static constexpr Chip8Quirks id = Chip8Quirks::Vip;
+	//8xy6 and 8xyE shift Vy into Vx rather than shifting Vx in place
+	static constexpr bool shift_uses_vy = true;
+	//Fx55 and Fx65 leave I pointing past the last regester stored or loaded
+	static constexpr bool load_store_increments_index = true;
+	//Bnnn is Bxnn and jumps to xnn + Vx rather than nnn + V0
+	static constexpr bool jump_uses_vx = false;
+	//8xy1, 8xy2 and 8xy3 clear VF
+	static constexpr bool logic_resets_vf = true;
+	//00Cn, 00FB - 00FF, 16x16 Dxy0 sprites, Fx30, Fx75 and Fx85 run. Without it 0x0 opcodes are matched on
+	//their low nibble only, so 0nn0 is 00E0 and 0nnE is 00EE, and the other SUPER-CHIP instructions do nothing
+	static constexpr bool super_chip = false;
+};
 
-class Chip8{
+struct SchipQuirks
+{
+	static constexpr Chip8Quirks id = Chip8Quirks::Schip;
+	static constexpr bool shift_uses_vy = false;
+	static constexpr bool load_store_increments_index = false;
+	static constexpr bool jump_uses_vx = true;
+	static constexpr bool logic_resets_vf = false;
+	static constexpr bool super_chip = true;
+};
+
+//what this interpreter has always done, and what chip8-recompile and Chip8Lockstep implement.
+//SUPER-CHIP ROMs get SchipQuirks from createChip8, here 0nn0 clears the screen and 0nnE returns as they always have
+struct ModernQuirks
+{
+	static constexpr Chip8Quirks id = Chip8Quirks::Modern;
+	static constexpr bool shift_uses_vy = false;
+	static constexpr bool load_store_increments_index = false;
+	static constexpr bool jump_uses_vx = false;
+	static constexpr bool logic_resets_vf = false;
+	static constexpr bool super_chip = false;
+};
+
+//lower case quirk names used on the command line of the tools
+char const* chip8QuirksName(Chip8Quirks quirks);
+//returns false if name is not one of the quirk names
+bool parseChip8Quirks(char const* name, Chip8Quirks& quirks);
+//the quirks a ROM was written for. A sidecar file next to the ROM, its name plus ".quirks", holding one of the
+//quirk names wins, then the extension: .sc8 ROMs are SCHIP and everything else gets the modern quirks.
+//Plain .ch8 files don't say which interpreter they target, so VIP ROMs need the sidecar or the tools' override
+Chip8Quirks chip8QuirksForRom(char const* filename);
+
+template<typename Quirks>
+class BasicChip8 : private Chip8State{
 public:
+
+	//Chip8Lockstep copies whole machines in and out of its lanes
+	friend class Chip8Lockstep;
+	//chip8-opcode-benchmark times the op_* handlers one at a time
+	friend class Chip8OpcodeBenchmark;
 	
-	Chip8(); //constructor
-	void loadROM(char const* filename);
+	BasicChip8(Chip8Engine engine = Chip8Engine::Table); //constructor
+	~BasicChip8();
+	//copies a ROM into memory at ROM_START_ADDRESS, returns false without loading anything
+	//if the file can't be read or the ROM is larger than MAX_ROM_SIZE
+	bool loadROM(char const* filename);
+	bool loadROM(std::span<const uint8_t> rom);
+	//puts the machine back the way loadROM left it, memory, regesters, stack, timers, display and keypad, in one copy.
+	//the random number generator keeps running so episodes differ, call seed after reset to repeat one
+	void reset();
+	//the state reset returns to, the power-on state until a ROM is loaded. It is immutable and shared,
+	//so many machines running the same ROM keep one copy. setBootImage also resets the machine
+	std::shared_ptr<Chip8Snapshot const> bootImage() const;
+	void setBootImage(std::shared_ptr<Chip8Snapshot const> image);
+	//runs one instruction, or one compiled block with the Jit and Static engines, and ticks the timers once per instruction
 	void cycle();
+	//runs a batch of instructions then ticks the timers once, call it TIMER_FREQUENCY times a second.
+	//Wait loops on the delay timer, Fx0A and jumps to self are fast-forwarded to the end of the frame
+	void runFrame(unsigned int instructionsPerFrame);
+	//turns the runFrame fast-forwarding on or off, the resulting state is the same either way
+	void setIdleSkipping(bool enabled);
+	//instructions runFrame counted as executed without running them
+	uint64_t skippedInstructions() const;
+	//current values of the timers
+	uint8_t delayTimer() const;
+	uint8_t soundTimer() const;
+	//number of instructions executed so far
+	uint64_t instructions() const;
+	//installs recompiled code for the Static engine, call after loadROM. Blocks a write overlaps are interpreted
+	//instead until loadState or reset puts their code back.
+	//returns false if the program was generated from a different ROM, or for quirks other than ModernQuirks
+	bool useStaticProgram(Chip8StaticProgram const* program);
 	//prints state used for debugging
 	void printState();
-	
-	uint8_t keypad[NUM_KEYS];
-	uint32_t display[DISPLAY_HIGHT * DISPLAY_WIDTH];
 
+	//restarts the random number generator from seed, runs started with the same seed and input are identical
+	void seed(uint64_t seed);
+
+	//copies the machine state out to or back in from a snapshot, the engine and draw policy are left as they are
+	void saveState(Chip8Snapshot& snapshot) const;
+	void loadState(Chip8Snapshot const& snapshot);
+
+	void setDrawPolicy(Chip8DrawPolicy policy);
+
+	//size of the display in pixels, DISPLAY_WIDTH x DISPLAY_HIGHT or HIRES_DISPLAY_WIDTH x HIRES_DISPLAY_HIGHT in hi-res
+	unsigned int displayWidth() const;
+	unsigned int displayHight() const;
+
+	//expands the display to one RGBA pixel per bit, displayWidth() * displayHight() entries.
+	//rows is a mask of the rows to convert, bit n being row n
+	void renderRGBA(uint32_t* pixels, uint64_t rows = 0xFFFFFFFFFFFFFFFFULL) const;
+
+	//incremented every time an instruction changes the display
+	uint64_t frameGeneration() const;
+
+	//mask of the rows changed since the last call, bit n being row n.
+	//switching resolution marks every row
+	uint64_t takeDirtyRows();
+
+	//FNV-1a hash of the display, for comparing the screens of runs without storing them
+	uint64_t displayHash() const;
+
+	//splits an opcode into its handler index and operands
+	static Chip8Instruction decode(uint16_t opcode);
 	
+	//both live in Chip8State so snapshots pick them up
+	using Chip8State::keypad;
+	using Chip8State::display;
+
 private:
 
+	//runs one instruction or compiled block without touching the timers, returns the instructions executed.
+	//JIT blocks stop after limit instructions and longer recompiled blocks are interpreted instead, so a frame never runs past its end
+	unsigned int step(unsigned int limit = 0xFFFFFFFFU);
+
+	//advances the emulated time the timers count down with
+	void tickTimers(unsigned int ticks);
+
+	//if pc is at the start of a wait loop that can't exit before the frame ends,
+	//skips all the whole iterations that fit in remaining instructions and returns how many were skipped
+	uint64_t skipIdleLoop(uint64_t remaining);
+
+	//splits an opcode into its operands, leaving the handler undecoded
+	static Chip8Instruction decodeOperands(uint16_t opcode);
+
+	//puts back the dropped static blocks whose memory matches the ROM they were recompiled from again
+	void restoreStaticBlocks();
+
+	//the state of a newly constructed machine, built once and shared
+	static Chip8Snapshot const& powerOnImage();
+
+	//decodes opcodes with a single switch and calls the matching handler directly
+	void execute();
+
+	//calls the handler for an already decoded instruction
+	void dispatch(uint8_t handler);
+
+	//runs one instruction from the middle of a JIT compiled block, pc already points past it
+	static void interpretForJit(Chip8State& state, uint16_t opcode);
+
+	//drops cached decodes covering memory[address] to memory[address + length - 1]
+	void invalidateCode(uint16_t address, uint16_t length);
+
+	//op_Dxyn for a sprite SpriteWidth pixels wide, its rows read from I on
+	template<unsigned int SpriteWidth>
+	void drawSprite(unsigned int height);
+
+	//switches between the lo-res and hi-res display, the two don't share a layout so the display is cleared
+	void setResolution(bool high);
+
 	void table0();
 
 	void table8();
@@ -45,6 +372,21 @@ private:
 
 	//RET returns from a subroutine
 	void op_00EE();
+
+	//SCD n scroll the display down n rows
+	void op_00Cn();
+
+	//SCR scroll the display right 4 pixels
+	void op_00FB();
+
+	//SCL scroll the display left 4 pixels
+	void op_00FC();
+
+	//LOW switch to the 64x32 display and clear it
+	void op_00FE();
+
+	//HIGH switch to the 128x64 display and clear it
+	void op_00FF();
 	
 	//JP jump to location nnn
 	void op_1nnn();
@@ -106,7 +448,8 @@ private:
 	//RND Vx, set Vx to the result from a random byte AND kk
 	void op_Cxkk();
 
-	//DRW Vx, Vy display n-byte sprite starting at memory location I at (Vx,Vy),Set VF = Collison
+	//DRW Vx, Vy display n-byte sprite starting at memory location I at (Vx,Vy),Set VF = Collison.
+	//with SUPER-CHIP Dxy0 draws a 16x16 sprite of two bytes per row
 	void op_Dxyn();
 	
 	//SKP Vx Skip the next instruction if the key with value of Vx is pressed
@@ -132,6 +475,9 @@ private:
 	
 	//LD F, Vx Set I equal to the location of sprite for digit Vx
 	void op_Fx29();
+
+	//LD HF, Vx Set I equal to the location of the big font sprite for digit Vx
+	void op_Fx30();
 	
 	//Ld B, Vx Store BCD reprsentation of Vx in Memory locations I, I+1 and I+2
 	void op_Fx33();
@@ -142,29 +488,69 @@ private:
 	//LD Vx, [I] Read regesters V0 - Vx from memory starting at location I
 	void op_Fx65();
 
+	//LD R, Vx Store regesters V0 - Vx in the flag regesters
+	void op_Fx75();
+
+	//LD Vx, R Read regesters V0 - Vx from the flag regesters
+	void op_Fx85();
+
 
-	uint8_t memory[MEMORY_SIZE];
-	uint8_t regesters[NUM_REGESTERS];	
-	uint16_t pc;
-	uint16_t index_regester;
-	uint16_t stack[STACK_SIZE];
-	uint8_t stack_pointer;
-	uint8_t sound_timer;
-	uint8_t delay_timer;
 	uint16_t opcodes;
+	Chip8Instruction instruction;
 
+	Chip8Engine engine;
 
-	//define random generator
-	std::default_random_engine rng;
-	std::uniform_int_distribution<uint8_t> random_byte;
+	//one decoded instruction per even address, only allocated for the Cached engine
+	std::unique_ptr<Chip8Instruction[]> decoded;
 
-	//define tables
-	typedef void(Chip8::*Chip8Function)();
+	//block compiler, only created for the Jit engine
+	std::unique_ptr<Chip8Jit> jit;
+
+	//blocks of the recompiled program indexed by pc / 2, set by useStaticProgram. A write can only overlap
+	//blocks starting less than the longest block's length before it, so invalidateCode only looks that far back
+	std::unique_ptr<Chip8StaticBlockEntry const*[]> static_blocks;
+	Chip8StaticProgram const* static_program;
+	uint16_t static_block_span;
+	//set once invalidateCode drops a block, loadState then looks for blocks whose code is back
+	bool static_blocks_dropped;
+
+	uint64_t instruction_count;
+
+	//set by loadROM, shared with every machine handed the same image
+	std::shared_ptr<Chip8Snapshot const> boot_image;
+
+	Chip8DrawPolicy draw_policy;
+
+	uint64_t frame_generation;
+	uint64_t dirty_rows;
+
+	bool idle_skipping;
+	uint64_t skipped_instructions;
+
+	//define tables, shared by every machine and defined constexpr in chip-8.cc
+	typedef void(BasicChip8::*Chip8Function)();
 	
-	Chip8Function FunctionTable[0xF + 1];
-	Chip8Function Table0[0xE + 1];
-	Chip8Function Table8[0xE + 1];
-	Chip8Function TableE[0xE + 1];
-	Chip8Function TableF[0x65 + 1];	
+	static const std::array<Chip8Function, 0xF + 1> FunctionTable;
+	static const std::array<Chip8Function, 0xFF + 1> Table0;
+	static const std::array<Chip8Function, 0xF + 1> Table8;
+	static const std::array<Chip8Function, 0xF + 1> TableE;
+	static const std::array<Chip8Function, 0xFF + 1> TableF;
 };
 
+extern template class BasicChip8<VipQuirks>;
+extern template class BasicChip8<SchipQuirks>;
+extern template class BasicChip8<ModernQuirks>;
+
+//the machine snapshots, movies, rewind, lockstep, the frontend and most tools run
+using Chip8 = BasicChip8<ModernQuirks>;
+
+//bytes a Chip8 may use on top of its machine state. Searches hold instances by the hundred thousand,
+//so anything every machine shares belongs in static data rather than in the object
+const unsigned int CHIP8_OVERHEAD_BUDGET = 128;
+static_assert(sizeof(Chip8) <= sizeof(Chip8State) + CHIP8_OVERHEAD_BUDGET, "Chip8 grew past its size budget");
+
+//One machine of whichever quirk set a ROM needs. Pick the instantiation once with createChip8, then
+//std::visit with a generic lambda so the loop running the machine is compiled once per quirk set
+using Chip8Variant = std::variant<BasicChip8<VipQuirks>, BasicChip8<SchipQuirks>, BasicChip8<ModernQuirks>>;
+
+std::unique_ptr<Chip8Variant> createChip8(Chip8Quirks quirks, Chip8Engine engine = Chip8Engine::Table);
@@ -0,0 +1,129 @@
+#include "framePacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+//bounds for the adaptive spin margin
+const std::chrono::microseconds MIN_SPIN_MARGIN(100);
+const std::chrono::microseconds MAX_SPIN_MARGIN(4000);
+
+//if the loop falls this many frames behind it gives up catching up and restarts the schedule from now
+const int MAX_FRAMES_BEHIND = 4;
+
+FramePacer::FramePacer(double framesPerSecond)
+{
+	frame_period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / framesPerSecond));
+	next_frame = Clock::now() + frame_period;
+	last_frame = Clock::now();
+	last_refresh = last_frame;
+	spin_margin = std::chrono::microseconds(1000);
+
+	frames = 0;
+	missed_frames = 0;
+	frame_time_sum = 0;
+	frame_time_squared_sum = 0;
+	frame_time_min = 0;
+	frame_time_max = 0;
+	lateness_max = 0;
+}
+
+void FramePacer::wait()
+{
+	Clock::time_point now = Clock::now();
+
+	//sleep through most of the wait, the OS may wake us up late so leave spin_margin to spin
+	if(next_frame - now > spin_margin)
+	{
+		Clock::time_point wake_up = next_frame - spin_margin;
+		std::this_thread::sleep_until(wake_up);
+
+		//learn how late the OS wakes us so the margin covers it next time, slowly shrinking it otherwise
+		Clock::duration oversleep = Clock::now() - wake_up;
+		spin_margin = std::max(oversleep + oversleep / 4, spin_margin - spin_margin / 64);
+		spin_margin = std::min<Clock::duration>(std::max<Clock::duration>(spin_margin, MIN_SPIN_MARGIN), MAX_SPIN_MARGIN);
+	}
+
+	while(Clock::now() < next_frame)
+	{
+		std::this_thread::yield();
+	}
+
+	now = Clock::now();
+	recordFrame(now, now - next_frame);
+
+	next_frame += frame_period;
+	if(now - next_frame > frame_period * MAX_FRAMES_BEHIND)
+	{
+		//the frame itself took too long, bursting through the backlog would only make things worse
+		missed_frames += (now - next_frame) / frame_period;
+		next_frame = now + frame_period;
+	}
+}
+
+unsigned int FramePacer::framesDue()
+{
+	Clock::time_point now = Clock::now();
+
+	//on a display refreshing at about the frame rate, a deadline this close to a refresh lands on either side of it
+	//from one refresh to the next, running 0 frames then 2, so the schedule is moved half a frame away from the refreshes.
+	//the refreshes slowly drift through the schedule, so that costs one repeated frame every so often
+	Clock::duration refresh = now - last_refresh;
+	Clock::duration refresh_error = refresh > frame_period ? refresh - frame_period : frame_period - refresh;
+	Clock::duration distance = now > next_frame ? now - next_frame : next_frame - now;
+	last_refresh = now;
+	if(refresh_error < frame_period / 8 && distance < frame_period / 8)
+	{
+		next_frame += frame_period / 2;
+	}
+
+	if(now < next_frame)
+	{
+		return 0;
+	}
+
+	recordFrame(now, now - next_frame);
+	unsigned int due = 0;
+	while(now >= next_frame)
+	{
+		next_frame += frame_period;
+		due++;
+	}
+
+	if(due > MAX_FRAMES_BEHIND)
+	{
+		//the same as wait, a long stall is skipped rather than run through in one burst
+		missed_frames += due - 1;
+		next_frame = now + frame_period;
+		due = 1;
+	}
+	return due;
+}
+
+void FramePacer::recordFrame(Clock::time_point now, Clock::duration lateness)
+{
+	double frame_time = std::chrono::duration<double, std::milli>(now - last_frame).count();
+	last_frame = now;
+
+	frames++;
+	frame_time_sum += frame_time;
+	frame_time_squared_sum += frame_time * frame_time;
+	frame_time_min = frames == 1 ? frame_time : std::min(frame_time_min, frame_time);
+	frame_time_max = std::max(frame_time_max, frame_time);
+	lateness_max = std::max(lateness_max, std::chrono::duration<double, std::micro>(lateness).count());
+}
+
+void FramePacer::printStatistics(std::ostream& out) const
+{
+	if(frames == 0)
+	{
+		return;
+	}
+
+	double mean = frame_time_sum / frames;
+	double variance = std::max(0.0, frame_time_squared_sum / frames - mean * mean);
+
+	out << "Frame pacing over " << frames << " frames" << std::endl;
+	out << "  frame time: mean " << mean << " ms, jitter (std dev) " << std::sqrt(variance) << " ms"
+		<< ", min " << frame_time_min << " ms, max " << frame_time_max << " ms" << std::endl;
+	out << "  worst lateness: " << lateness_max << " us, dropped frames: " << missed_frames << std::endl;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+//Paces a loop to a fixed frame rate without spinning a core.
+//Sleeps until shortly before each deadline then spins for the last stretch, and schedules deadlines
+//from the previous deadline rather than the wake up time so sleep errors don't add up to drift.
+//When something else already blocks the loop, like presenting with vsync, framesDue only counts the deadlines
+//that passed instead of waiting a second time, so the display drives the loop and the pacer corrects the drift
+//between its refresh rate and the frame rate
+class FramePacer
+{
+public:
+
+	FramePacer(double framesPerSecond);
+
+	//blocks until the next frame is due
+	void wait();
+	//returns how many frames came due since the last call without blocking, 0 when the display refreshes faster
+	//than the frame rate and more than 1 when a refresh ran long
+	unsigned int framesDue();
+
+	//prints frame time and lateness statistics gathered by wait()
+	void printStatistics(std::ostream& out) const;
+
+private:
+
+	typedef std::chrono::steady_clock Clock;
+
+	//adds a frame that started at now, lateness after its deadline, to the statistics
+	void recordFrame(Clock::time_point now, Clock::duration lateness);
+
+	Clock::duration frame_period;
+	Clock::time_point next_frame;
+	Clock::time_point last_frame;
+	//when framesDue was last called
+	Clock::time_point last_refresh;
+
+	//how long before a deadline sleeping stops and spinning starts, adapts to how much the OS oversleeps
+	Clock::duration spin_margin;
+
+	uint64_t frames;
+	uint64_t missed_frames;
+	double frame_time_sum;
+	double frame_time_squared_sum;
+	double frame_time_min;
+	double frame_time_max;
+	double lateness_max;
+};
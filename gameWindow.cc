@@ -2,7 +2,7 @@
 #include <iostream>
 
 
-GameWindow::GameWindow(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight)
+GameWindow::GameWindow(char const* title, int windowWidth, int windowHeight, int textureWidth, int textureHeight, bool vsync)
 {
 	//Initializes the SDL Video lib needed for graphics
 	SDL_Init(SDL_INIT_VIDEO);
@@ -20,9 +20,14 @@ GameWindow::GameWindow(char const* title, int windowWidth, int windowHeight, int
 		windowHeight,
 		SDL_WINDOW_RESIZABLE);
 
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | (vsync ? SDL_RENDERER_PRESENTVSYNC : 0));
+	SDL_RendererInfo info;
+	vsync_active = SDL_GetRendererInfo(renderer, &info) == 0 && (info.flags & SDL_RENDERER_PRESENTVSYNC);
 	
 	texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, textureWidth, textureHeight);
+	texture_width = textureWidth;
+	texture_height = textureHeight;
+	redraw = true;
 
 }
 
@@ -34,15 +39,79 @@ GameWindow::~GameWindow()
 	SDL_Quit();
 }
 
-void GameWindow::Update(void const* buffer, int pitch)
+bool GameWindow::Update(void const* buffer, int pitch, int width, int height, uint64_t dirtyRows)
 {
-	SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+	if(width != texture_width || height != texture_height)
+	{
+		//the resolution changed, a new texture starts out undefined so all of it is uploaded
+		SDL_DestroyTexture(texture);
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+		texture_width = width;
+		texture_height = height;
+		dirtyRows = 0xFFFFFFFFFFFFFFFFULL;
+	}
+
+	if(dirtyRows == 0 && !redraw)
+	{
+		return false;
+	}
+
+	if(dirtyRows != 0)
+	{
+		//find the span between the first and last dirty row and upload only that part of the texture
+		int first = 0;
+		int last = texture_height - 1;
+		while(!(dirtyRows & (1ULL << first)))
+		{
+			first++;
+		}
+		while(!(dirtyRows & (1ULL << last)))
+		{
+			last--;
+		}
+
+		SDL_Rect rows = {0, first, texture_width, last - first + 1};
+		SDL_UpdateTexture(texture, &rows, static_cast<uint8_t const*>(buffer) + first * pitch, pitch);
+	}
+
+	redraw = false;
 	SDL_RenderClear(renderer);
 	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-	SDL_RenderPresent(renderer);	
+	SDL_RenderPresent(renderer);
+	return true;
+}
+
+bool GameWindow::vsync() const
+{
+	return vsync_active;
 }
 
-bool GameWindow::processInput(uint8_t* keys)
+//chip-8 key for a keyboard key, -1 if it isn't mapped
+static int keypadIndex(SDL_Keycode key)
+{
+	switch(key)
+	{
+		case SDLK_x: return 0;
+		case SDLK_1: return 1;
+		case SDLK_2: return 2;
+		case SDLK_3: return 3;
+		case SDLK_q: return 4;
+		case SDLK_w: return 5;
+		case SDLK_e: return 6;
+		case SDLK_a: return 7;
+		case SDLK_s: return 8;
+		case SDLK_d: return 9;
+		case SDLK_z: return 0xA;
+		case SDLK_c: return 0xB;
+		case SDLK_4: return 0xC;
+		case SDLK_r: return 0xD;
+		case SDLK_f: return 0xE;
+		case SDLK_v: return 0xF;
+	}
+	return -1;
+}
+
+bool GameWindow::processInput(uint8_t* keys, bool& rewinding)
 {
 	bool quit = false;
 	SDL_Event event;
@@ -56,96 +125,41 @@ bool GameWindow::processInput(uint8_t* keys)
 				quit = true;
 			}break;
 
+			case SDL_WINDOWEVENT:
+			{
+				redraw = true;
+			}break;
+
 			case SDL_KEYDOWN:
 			{
-				switch(event.key.keysym.sym)
+				int key = keypadIndex(event.key.keysym.sym);
+				if(key >= 0)
 				{
-					case SDLK_ESCAPE:
-					{
-						quit = true;
-					}break;
-		
-					case SDLK_x:
-					{
-						keys[0] = 1;	
-					}break;
-
-					case SDLK_1:
-					{
-						keys[1] = 1;
-					}break;
-
-					case SDLK_2:
-					{
-						keys[2] = 1;
-					}break;
-				
-					case SDLK_3:
-					{
-						keys[3] = 1;
-					}break;
-				
-					case SDLK_q:
-					{
-						keys[4] = 1;
-					}break;
-					
-					case SDLK_w:
-					{
-						keys[5] = 1;
-					}break;
-	
-					case SDLK_e:
-					{
-						keys[6] = 1;
-					}break;
-	
-					case SDLK_a:
-					{
-						keys[7] = 1;
-					}break;
-
-					case SDLK_s:
-					{
-						keys[8] = 1;
-					}break;
-
-					case SDLK_d:
-					{
-						keys[9] = 1;
-					}break;
-					
-					case SDLK_z:
-					{
-						keys[0xA] = 1;
-					}break;
-					
-					case SDLK_c:
-					{
-						keys[0xB] = 1;
-					}break;
-					
-					case SDLK_4:
-					{
-						keys[0xC] = 1;
-					}break;
-					
-					case SDLK_r:
-					{
-						keys[0xD] = 1;
-					}break;
-					
-					case SDLK_f:
-					{
-						keys[0xE] = 1;
-					}break;
-
-					case SDLK_v:
-					{
-						keys[0xF] = 1;
-					}break;				
+					keys[key] = 1;
 				}
-			}
+				else if(event.key.keysym.sym == SDLK_ESCAPE)
+				{
+					quit = true;
+				}
+				else if(event.key.keysym.sym == SDLK_BACKSPACE)
+				{
+					rewinding = true;
+				}
+			}break;
+
+			//keys are released as well so recorded input has both edges
+			case SDL_KEYUP:
+			{
+				int key = keypadIndex(event.key.keysym.sym);
+				if(key >= 0)
+				{
+					keys[key] = 0;
+				}
+				else if(event.key.keysym.sym == SDLK_BACKSPACE)
+				{
+					rewinding = false;
+				}
+			}break;
 		}
 	}
 	return quit;	
@@ -10,10 +10,17 @@ class GameWindow
 
 public:
 
-	GameWindow(char const* title, int windowWidth, int windowHeight, int texturedWidth, int texturedHeight);
+	//with vsync presenting waits for the display refresh
+	GameWindow(char const* title, int windowWidth, int windowHeight, int texturedWidth, int texturedHeight, bool vsync = false);
 	~GameWindow();
-	void Update(void const* buffer, int pitch);
-	bool processInput(uint8_t* keys);
+	//uploads the rows set in dirtyRows (bit n being row n) of a width x height frame and presents them,
+	//does nothing if no row changed and the window doesn't need repainting. Returns whether it presented.
+	//When the size differs from the last frame only the texture is replaced, the window is kept and scales it
+	bool Update(void const* buffer, int pitch, int width, int height, uint64_t dirtyRows);
+	//whether presenting really waits for the display refresh, the driver may not give vsync when asked
+	bool vsync() const;
+	//returns true when the window is closed, rewinding is set while backspace is held
+	bool processInput(uint8_t* keys, bool& rewinding);
 	
 private:
 
@@ -22,5 +29,11 @@ private:
 	GLuint framebuffer_texture;
 	SDL_Renderer* renderer;
 	SDL_Texture* texture;
+	int texture_width;
+	int texture_height;
+
+	//set when the window was resized or uncovered and has to be presented again
+	bool redraw;
+	bool vsync_active;
 }; 	
 	
@@ -0,0 +1,100 @@
+#include "instancePool.h"
+#include "romCache.h"
+#include <cassert>
+
+Chip8InstancePool::Chip8InstancePool(unsigned int capacity, Chip8Engine engine)
+{
+	machines.reserve(capacity);
+	free_machines.reserve(capacity);
+	in_use.assign(capacity, 0);
+	for(unsigned int i = 0; i < capacity; i++)
+	{
+		machines.emplace_back(new Chip8(engine));
+		slots.emplace(machines.back().get(), i);
+		free_machines.push_back(machines.back().get());
+	}
+}
+
+bool Chip8InstancePool::loadROM(char const* filename)
+{
+	std::span<const uint8_t> rom;
+	if(!Chip8RomCache::shared().get(filename, rom))
+	{
+		return false;
+	}
+	return loadROM(rom);
+}
+
+bool Chip8InstancePool::loadROM(std::span<const uint8_t> rom)
+{
+	if(machines.empty())
+	{
+		return false;
+	}
+	if(!machines[0]->loadROM(rom))
+	{
+		return false;
+	}
+
+	std::shared_ptr<Chip8Snapshot const> image = machines[0]->bootImage();
+	for(auto& machine : machines)
+	{
+		machine->setBootImage(image);
+	}
+	return true;
+}
+
+Chip8* Chip8InstancePool::acquire()
+{
+	Chip8* chip8;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if(free_machines.empty())
+		{
+			return nullptr;
+		}
+		chip8 = free_machines.back();
+		free_machines.pop_back();
+		in_use[slots.find(chip8)->second] = 1;
+	}
+
+	//outside the lock so threads only contend on the free list
+	chip8->reset();
+	return chip8;
+}
+
+bool Chip8InstancePool::release(Chip8* chip8)
+{
+	if(chip8 == nullptr)
+	{
+		return false;
+	}
+
+	auto slot = slots.find(chip8);
+	assert(slot != slots.end() && "released a machine that isn't from this pool");
+	if(slot == slots.end())
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+	assert(in_use[slot->second] && "released a machine twice");
+	if(!in_use[slot->second])
+	{
+		return false;
+	}
+	in_use[slot->second] = 0;
+	free_machines.push_back(chip8);
+	return true;
+}
+
+unsigned int Chip8InstancePool::capacity() const
+{
+	return machines.size();
+}
+
+unsigned int Chip8InstancePool::available() const
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return free_machines.size();
+}
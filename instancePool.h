@@ -0,0 +1,48 @@
+#pragma once
+
+#include "chip-8.h"
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+#include <vector>
+
+//A fixed set of Chip8s running the same ROM, handed out and taken back for episode after episode.
+//Every machine is built and loaded up front and they all share one boot image, so acquire costs a
+//reset and release costs nothing, neither touches the heap or the ROM file. Safe to use from several threads
+class Chip8InstancePool
+{
+public:
+
+	Chip8InstancePool(unsigned int capacity, Chip8Engine engine = Chip8Engine::Cached);
+
+	Chip8InstancePool(Chip8InstancePool const&) = delete;
+	Chip8InstancePool& operator=(Chip8InstancePool const&) = delete;
+
+	//loads a ROM into every machine, returns false without changing anything if it can't be loaded.
+	//only call while no machine is acquired
+	bool loadROM(char const* filename);
+	bool loadROM(std::span<const uint8_t> rom);
+
+	//a machine reset to the boot image, or nullptr if they are all in use
+	Chip8* acquire();
+	//hands a machine from acquire back to the pool. returns false, and asserts in debug builds, for a machine
+	//that isn't from this pool or was already released, so the free list never holds more than capacity
+	bool release(Chip8* chip8);
+
+	unsigned int capacity() const;
+	//machines not acquired right now
+	unsigned int available() const;
+
+private:
+
+	std::vector<std::unique_ptr<Chip8>> machines;
+	//index of each machine in machines, only read after construction
+	std::unordered_map<Chip8 const*, unsigned int> slots;
+
+	mutable std::mutex lock;
+	//stack of machines not in use, reserved to capacity so pushing never allocates
+	std::vector<Chip8*> free_machines;
+	//per machine, set while it is acquired
+	std::vector<uint8_t> in_use;
+};
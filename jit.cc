@@ -0,0 +1,679 @@
+#include "jit.h"
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) && (defined(__unix__) || defined(__APPLE__))
+#define CHIP8_JIT_SUPPORTED 1
+#include <sys/mman.h>
+#endif
+
+//room for the blocks of a whole ROM in the usual case, when it fills up every block is dropped and compiled again
+const size_t JIT_BUFFER_SIZE = 128 * 1024;
+
+//longest run of instructions compiled into one block
+const unsigned int MAX_BLOCK_LENGTH = 64;
+
+//longest machine code sequence emitted for a single instruction, Fx55 storing all sixteen regesters,
+//with the budget check in front of it
+const unsigned int MAX_INSTRUCTION_BYTES = 224;
+
+//the prologue that starts a block and the pc store and epilogue that end one
+const unsigned int BLOCK_OVERHEAD_BYTES = 48;
+
+//generated code gets the Chip8State pointer in rdi and the instruction budget in esi (System V ABI).
+//It moves the budget to r8d and points rsi at the regesters, so [rsi + x] addresses Vx and every other field
+//but memory and the generator is a short offset from rsi. rdi and r8 are saved around calls into the interpreter
+namespace
+{
+	const size_t REGESTERS = offsetof(Chip8State, regesters);
+
+	constexpr uint8_t fromRegesters(size_t offset)
+	{
+		return offset - REGESTERS;
+	}
+
+	const uint8_t PC = fromRegesters(offsetof(Chip8State, pc));
+	const uint8_t INDEX = fromRegesters(offsetof(Chip8State, index_regester));
+	const uint8_t STACK = fromRegesters(offsetof(Chip8State, stack));
+	const uint8_t STACK_POINTER = fromRegesters(offsetof(Chip8State, stack_pointer));
+	const uint8_t SOUND_TIMER = fromRegesters(offsetof(Chip8State, sound_timer));
+	const uint8_t DELAY_TIMER = fromRegesters(offsetof(Chip8State, delay_timer));
+	const uint8_t SOUND_TIMER_START = fromRegesters(offsetof(Chip8State, sound_timer_start));
+	const uint8_t DELAY_TIMER_START = fromRegesters(offsetof(Chip8State, delay_timer_start));
+	const uint8_t TIMER_TICKS = fromRegesters(offsetof(Chip8State, timer_ticks));
+	const uint8_t KEYPAD = fromRegesters(offsetof(Chip8State, keypad));
+	static_assert(offsetof(Chip8State, keypad) + NUM_KEYS - REGESTERS <= 0x7F, "rsi relative fields need an 8 bit displacement");
+
+	struct Emitter
+	{
+		uint8_t* out;
+		size_t used;
+
+		void bytes(std::initializer_list<uint8_t> list)
+		{
+			for(uint8_t byte : list)
+			{
+				out[used++] = byte;
+			}
+		}
+
+		void value(uint64_t value, unsigned int size)
+		{
+			for(unsigned int i = 0; i < size; i++)
+			{
+				out[used++] = (value >> (8U * i)) & 0xFFU;
+			}
+		}
+
+		//mov ecx, value; mov [rsi+field], cx
+		//rather than a mov word with an immediate, whose length changing prefix stalls the decoder
+		void storeWord(uint8_t field, uint16_t word)
+		{
+			bytes({0xB9});
+			value(word, 4);
+			bytes({0x66, 0x89, 0x4E, field});
+		}
+
+		void setPc(uint16_t address)
+		{
+			storeWord(PC, address);
+		}
+
+		//mov r8d, esi; lea rsi, [rdi + REGESTERS]
+		void prologue()
+		{
+			bytes({0x41, 0x89, 0xF0, 0x48, 0x8D, 0xB7});
+			value(REGESTERS, 4);
+		}
+
+		//mov eax, executed; ret
+		void epilogue(unsigned int executed)
+		{
+			bytes({0xB8});
+			value(executed, 4);
+			bytes({0xC3});
+		}
+
+		//leaves the block before the instruction at address once executed instructions have used up the budget
+		//cmp r8d, executed; ja next; mov word [rsi+PC], address; epilogue; next:
+		void checkBudget(unsigned int executed, uint16_t address)
+		{
+			bytes({0x41, 0x83, 0xF8, (uint8_t)executed, 0x77, 0x0F});
+			setPc(address);
+			epilogue(executed);
+		}
+
+		//push rdi; push r8; sub rsp, 8; mov esi, opcode; mov rax, interpret; call rax
+		//add rsp, 8; pop r8; pop rdi; lea rsi, [rdi + REGESTERS]
+		//the sub keeps the stack 16 byte aligned for the call
+		void interpret(Chip8Jit::InterpretFunction function, uint16_t opcode)
+		{
+			bytes({0x57, 0x41, 0x50, 0x48, 0x83, 0xEC, 0x08, 0xBE});
+			value(opcode, 4);
+			bytes({0x48, 0xB8});
+			value(reinterpret_cast<uintptr_t>(function), 8);
+			bytes({0xFF, 0xD0, 0x48, 0x83, 0xC4, 0x08, 0x41, 0x58, 0x5F, 0x48, 0x8D, 0xB7});
+			value(REGESTERS, 4);
+		}
+
+		//movzx edx, word [rsi+INDEX]; or edx, length << 16; mov rax, pendingWrite; mov [rax], edx
+		//so run() can drop the blocks a store overwrote
+		void recordWrite(uint32_t* pendingWrite, uint8_t length)
+		{
+			bytes({0x0F, 0xB7, 0x56, INDEX, 0x81, 0xCA});
+			value((uint32_t)length << 16U, 4);
+			bytes({0x48, 0xB8});
+			value(reinterpret_cast<uintptr_t>(pendingWrite), 8);
+			bytes({0x89, 0x10});
+		}
+
+		//mov eax, next; mov ecx, next + 2; cmovcc eax, ecx; mov [rsi+PC], ax
+		//the comparison has already set the flags, the movs leave them alone
+		void skip(uint8_t cmov, uint16_t next)
+		{
+			bytes({0xB8});
+			value(next, 4);
+			bytes({0xB9});
+			value(next + 2U, 4);
+			bytes({0x0F, cmov, 0xC1, 0x66, 0x89, 0x46, PC});
+		}
+	};
+
+	const uint8_t CMOVE = 0x44;
+	const uint8_t CMOVNE = 0x45;
+
+	//whether a block can hand the instruction to the interpreter and carry on after it.
+	//0nnE returns without SUPER-CHIP, every other instruction the JIT doesn't emit itself leaves pc alone
+	bool interpretedInBlock(uint16_t opcode)
+	{
+		return (opcode & 0xF000U) != 0 || (opcode & 0x000FU) != 0xE;
+	}
+
+	//emits the x86-64 code for an instruction that falls through to the next one, returns false if it isn't one the JIT handles.
+	//Every sequence reproduces the interpreter's op_* handler exactly, including the order VF is written in
+	bool emitStraight(Emitter& e, uint16_t opcode, Chip8JitQuirks const& quirks)
+	{
+		uint8_t x = (opcode & 0x0F00U) >> 8U;
+		uint8_t y = (opcode & 0x00F0U) >> 4U;
+		//the regester 8xy6 and 8xyE shift
+		uint8_t s = quirks.shift_uses_vy ? y : x;
+		uint8_t kk = opcode & 0x00FFU;
+		uint16_t nnn = opcode & 0x0FFFU;
+
+		switch((opcode & 0xF000U) >> 12U)
+		{
+			//LD Vx, kk: mov byte [rsi+x], kk
+			case 0x6: e.bytes({0xC6, 0x46, x, kk}); return true;
+
+			//ADD Vx, kk: add byte [rsi+x], kk
+			case 0x7: e.bytes({0x80, 0x46, x, kk}); return true;
+
+			case 0x8:
+			{
+				switch(opcode & 0x000FU)
+				{
+					//LD Vx, Vy: mov al, [rsi+y]; mov [rsi+x], al
+					case 0x0: e.bytes({0x8A, 0x46, y, 0x88, 0x46, x}); return true;
+
+					//OR/AND/XOR Vx, Vy: mov al, [rsi+y]; op [rsi+x], al
+					//then with the VF reset quirk mov byte [rsi+15], 0
+					case 0x1: e.bytes({0x8A, 0x46, y, 0x08, 0x46, x}); break;
+					case 0x2: e.bytes({0x8A, 0x46, y, 0x20, 0x46, x}); break;
+					case 0x3: e.bytes({0x8A, 0x46, y, 0x30, 0x46, x}); break;
+
+					//ADD Vx, Vy: mov al, [rsi+x]; add al, [rsi+y]; setc dl; mov [rsi+x], al; mov [rsi+15], dl
+					case 0x4: e.bytes({0x8A, 0x46, x, 0x02, 0x46, y, 0x0F, 0x92, 0xC2, 0x88, 0x46, x, 0x88, 0x56, 0x0F}); return true;
+
+					//SUB Vx, Vy: mov al, [rsi+x]; mov cl, [rsi+y]; cmp al, cl; seta dl; sub al, cl
+					//            mov [rsi+15], dl; mov [rsi+x], al
+					case 0x5: e.bytes({0x8A, 0x46, x, 0x8A, 0x4E, y, 0x38, 0xC8, 0x0F, 0x97, 0xC2, 0x28, 0xC8,
+							0x88, 0x56, 0x0F, 0x88, 0x46, x}); return true;
+
+					//SHR Vx: mov al, [rsi+s]; and al, 1; mov [rsi+15], al; mov al, [rsi+s]; shr al, 1; mov [rsi+x], al
+					case 0x6: e.bytes({0x8A, 0x46, s, 0x24, 0x01, 0x88, 0x46, 0x0F,
+							0x8A, 0x46, s, 0xD0, 0xE8, 0x88, 0x46, x}); return true;
+
+					//SUBN Vx, Vy: mov al, [rsi+x]; mov cl, [rsi+y]; cmp cl, al; seta dl; mov [rsi+15], dl
+					//             mov al, [rsi+y]; sub al, [rsi+x]; mov [rsi+x], al
+					case 0x7: e.bytes({0x8A, 0x46, x, 0x8A, 0x4E, y, 0x38, 0xC1, 0x0F, 0x97, 0xC2, 0x88, 0x56, 0x0F,
+							0x8A, 0x46, y, 0x2A, 0x46, x, 0x88, 0x46, x}); return true;
+
+					//SHL Vx: mov al, [rsi+s]; shr al, 7; mov [rsi+15], al; mov al, [rsi+s]; add al, al; mov [rsi+x], al
+					case 0xE: e.bytes({0x8A, 0x46, s, 0xC0, 0xE8, 0x07, 0x88, 0x46, 0x0F,
+							0x8A, 0x46, s, 0x00, 0xC0, 0x88, 0x46, x}); return true;
+
+					default: return false;
+				}
+
+				//only the logic instructions get here
+				if(quirks.logic_resets_vf)
+				{
+					e.bytes({0xC6, 0x46, 0x0F, 0x00});
+				}
+				return true;
+			}
+
+			//LD I, nnn
+			case 0xA: e.storeWord(INDEX, nnn); return true;
+
+			//RND Vx, kk: the xorshift64* step of chip8RandomByte on rng_state, which is too far from rsi so goes through rdi
+			//mov rax, [rdi+rng]; mov rdx, rax; shr rdx, 12; xor rax, rdx; mov rdx, rax; shl rdx, 25; xor rax, rdx
+			//mov rdx, rax; shr rdx, 27; xor rax, rdx; mov [rdi+rng], rax
+			//mov rdx, 0x2545F4914F6CDD1D; imul rax, rdx; shr rax, 56; and al, kk; mov [rsi+x], al
+			case 0xC:
+			{
+				uint32_t rng = offsetof(Chip8State, rng_state);
+				e.bytes({0x48, 0x8B, 0x87});
+				e.value(rng, 4);
+				e.bytes({0x48, 0x89, 0xC2, 0x48, 0xC1, 0xEA, 0x0C, 0x48, 0x31, 0xD0,
+					0x48, 0x89, 0xC2, 0x48, 0xC1, 0xE2, 0x19, 0x48, 0x31, 0xD0,
+					0x48, 0x89, 0xC2, 0x48, 0xC1, 0xEA, 0x1B, 0x48, 0x31, 0xD0,
+					0x48, 0x89, 0x87});
+				e.value(rng, 4);
+				e.bytes({0x48, 0xBA});
+				e.value(0x2545F4914F6CDD1DULL, 8);
+				e.bytes({0x48, 0x0F, 0xAF, 0xC2, 0x48, 0xC1, 0xE8, 0x38, 0x24, kk, 0x88, 0x46, x});
+			}return true;
+
+			case 0xF:
+			{
+				switch(kk)
+				{
+					//LD Vx, DT: the delay timer as delayTimer() works it out
+					//mov rax, [rsi+ticks]; sub rax, [rsi+start]; movzx ecx, byte [rsi+DT]; xor edx, edx
+					//sub rcx, rax; cmovb ecx, edx; mov [rsi+x], cl
+					case 0x07: e.bytes({0x48, 0x8B, 0x46, TIMER_TICKS, 0x48, 0x2B, 0x46, DELAY_TIMER_START,
+							0x0F, 0xB6, 0x4E, DELAY_TIMER, 0x31, 0xD2, 0x48, 0x29, 0xC1, 0x0F, 0x42, 0xCA,
+							0x88, 0x4E, x}); return true;
+
+					//LD DT, Vx and LD ST, Vx: mov al, [rsi+x]; mov [rsi+timer], al; mov rax, [rsi+ticks]; mov [rsi+start], rax
+					case 0x15: e.bytes({0x8A, 0x46, x, 0x88, 0x46, DELAY_TIMER,
+							0x48, 0x8B, 0x46, TIMER_TICKS, 0x48, 0x89, 0x46, DELAY_TIMER_START}); return true;
+					case 0x18: e.bytes({0x8A, 0x46, x, 0x88, 0x46, SOUND_TIMER,
+							0x48, 0x8B, 0x46, TIMER_TICKS, 0x48, 0x89, 0x46, SOUND_TIMER_START}); return true;
+
+					//ADD I, Vx: movzx eax, byte [rsi+x]; add [rsi+INDEX], ax
+					case 0x1E: e.bytes({0x0F, 0xB6, 0x46, x, 0x66, 0x01, 0x46, INDEX}); return true;
+
+					//LD F, Vx: movzx eax, byte [rsi+x]; lea eax, [rax + rax*4 + FONT_START_ADDRESS]; mov [rsi+INDEX], ax
+					case 0x29: e.bytes({0x0F, 0xB6, 0x46, x, 0x8D, 0x44, 0x80, (uint8_t)FONT_START_ADDRESS, 0x66, 0x89, 0x46, INDEX}); return true;
+
+					//LD Vx, [I]: movzx eax, word [rsi+INDEX], then for every regester mov cl, [rdi+rax+i]; mov [rsi+i], cl
+					//and with the quirk add word [rsi+INDEX], x + 1
+					case 0x65:
+					{
+						e.bytes({0x0F, 0xB7, 0x46, INDEX});
+						for(uint8_t i = 0; i <= x; i++)
+						{
+							e.bytes({0x8A, 0x4C, 0x07, i, 0x88, 0x4E, i});
+						}
+						if(quirks.load_store_increments_index)
+						{
+							e.bytes({0x66, 0x83, 0x46, INDEX, (uint8_t)(x + 1)});
+						}
+					}return true;
+				}
+			}break;
+		}
+
+		return false;
+	}
+
+	//emits the comparison of a skip instruction, returns false if it isn't one.
+	//cmov gets the cmovcc opcode that picks the skip, the matching jcc is cmov + 0x40
+	bool emitSkipTest(Emitter& e, uint16_t opcode, uint8_t& cmov)
+	{
+		uint8_t x = (opcode & 0x0F00U) >> 8U;
+		uint8_t y = (opcode & 0x00F0U) >> 4U;
+		uint8_t kk = opcode & 0x00FFU;
+
+		switch((opcode & 0xF000U) >> 12U)
+		{
+			//SE Vx, kk and SNE Vx, kk: cmp byte [rsi+x], kk
+			case 0x3: e.bytes({0x80, 0x7E, x, kk}); cmov = CMOVE; return true;
+			case 0x4: e.bytes({0x80, 0x7E, x, kk}); cmov = CMOVNE; return true;
+
+			//SE Vx, Vy and SNE Vx, Vy: mov dl, [rsi+x]; cmp dl, [rsi+y]
+			case 0x5: e.bytes({0x8A, 0x56, x, 0x3A, 0x56, y}); cmov = CMOVE; return true;
+			case 0x9: e.bytes({0x8A, 0x56, x, 0x3A, 0x56, y}); cmov = CMOVNE; return true;
+
+			//SKP Vx and SKNP Vx: movzx eax, byte [rsi+x]; cmp byte [rsi+rax+KEYPAD], 0
+			case 0xE:
+			{
+				switch(opcode & 0x000FU)
+				{
+					case 0xE: e.bytes({0x0F, 0xB6, 0x46, x, 0x80, 0x7C, 0x06, KEYPAD, 0x00}); cmov = CMOVNE; return true;
+					case 0x1: e.bytes({0x0F, 0xB6, 0x46, x, 0x80, 0x7C, 0x06, KEYPAD, 0x00}); cmov = CMOVE; return true;
+				}
+			}break;
+		}
+
+		return false;
+	}
+
+	//whether the instruction is a jump, call or return the JIT emits, the ones a skip can step over inside a block
+	bool isJump(uint16_t opcode)
+	{
+		switch((opcode & 0xF000U) >> 12U)
+		{
+			case 0x0: return opcode == 0x00EEU;
+			case 0x1:
+			case 0x2:
+			case 0xB: return true;
+		}
+		return false;
+	}
+
+	//emits an instruction that ends the block by setting pc itself, returns false if it isn't one.
+	//next is the address after the instruction, Fx33 and Fx55 leave what they stored in pendingWrite
+	bool emitTerminator(Emitter& e, uint16_t opcode, uint16_t next, Chip8JitQuirks const& quirks, uint32_t* pendingWrite)
+	{
+		uint8_t x = (opcode & 0x0F00U) >> 8U;
+		uint8_t kk = opcode & 0x00FFU;
+		uint16_t nnn = opcode & 0x0FFFU;
+
+		uint8_t cmov;
+		if(emitSkipTest(e, opcode, cmov))
+		{
+			e.skip(cmov, next);
+			return true;
+		}
+
+		switch((opcode & 0xF000U) >> 12U)
+		{
+			//RET: dec byte [rsi+SP]; movzx eax, byte [rsi+SP]; mov ax, [rsi+rax*2+STACK]; mov [rsi+PC], ax.
+			//only 00EE itself, the other 0nnE that return without SUPER-CHIP are left to the interpreter
+			case 0x0:
+			{
+				if(opcode != 0x00EEU)
+				{
+					return false;
+				}
+				e.bytes({0xFE, 0x4E, STACK_POINTER, 0x0F, 0xB6, 0x46, STACK_POINTER, 0x66, 0x8B, 0x44, 0x46, STACK, 0x66, 0x89, 0x46, PC});
+			}return true;
+
+			//JP nnn
+			case 0x1: e.setPc(nnn); return true;
+
+			//CALL nnn: movzx eax, byte [rsi+SP]; mov ecx, next; mov [rsi+rax*2+STACK], cx; inc byte [rsi+SP]; then the jump
+			case 0x2:
+			{
+				e.bytes({0x0F, 0xB6, 0x46, STACK_POINTER, 0xB9});
+				e.value(next, 4);
+				e.bytes({0x66, 0x89, 0x4C, 0x46, STACK, 0xFE, 0x46, STACK_POINTER});
+				e.setPc(nnn);
+			}return true;
+
+			//JP V0, nnn: movzx eax, byte [rsi+r]; add eax, nnn; mov [rsi+PC], ax
+			case 0xB:
+			{
+				uint8_t r = quirks.jump_uses_vx ? x : 0;
+				e.bytes({0x0F, 0xB6, 0x46, r, 0x05});
+				e.value(nnn, 4);
+				e.bytes({0x66, 0x89, 0x46, PC});
+			}return true;
+
+			//the stores end the block, they may have overwritten the code after them, and run() drops the blocks they hit.
+			//pc moves on first, as it has in the interpreter by the time the handler runs
+			case 0xF:
+			{
+				switch(kk)
+				{
+					//LD B, Vx: each digit is worked out from Vx afresh and stored at I in the interpreter's order
+					//movzx eax, byte [rsi+x]; mov cl, divisor; div cl; (movzx eax, al; mov cl, 10; div cl)
+					//movzx edx, word [rsi+INDEX]; mov [rdi+rdx+digit], ah
+					case 0x33:
+					{
+						e.setPc(next);
+						e.recordWrite(pendingWrite, 3);
+						e.bytes({0x0F, 0xB6, 0x46, x, 0xB1, 0x0A, 0xF6, 0xF1,
+							0x0F, 0xB7, 0x56, INDEX, 0x88, 0x64, 0x17, 0x02});
+						e.bytes({0x0F, 0xB6, 0x46, x, 0xB1, 0x0A, 0xF6, 0xF1, 0x0F, 0xB6, 0xC0, 0xF6, 0xF1,
+							0x0F, 0xB7, 0x56, INDEX, 0x88, 0x64, 0x17, 0x01});
+						e.bytes({0x0F, 0xB6, 0x46, x, 0xB1, 0x64, 0xF6, 0xF1, 0x0F, 0xB6, 0xC0, 0xB1, 0x0A, 0xF6, 0xF1,
+							0x0F, 0xB7, 0x56, INDEX, 0x88, 0x64, 0x17, 0x00});
+					}return true;
+
+					//LD [I], Vx: for every regester movzx eax, word [rsi+INDEX]; mov cl, [rsi+i]; mov [rdi+rax+i], cl
+					//and with the quirk add word [rsi+INDEX], x + 1
+					case 0x55:
+					{
+						e.setPc(next);
+						e.recordWrite(pendingWrite, x + 1);
+						for(uint8_t i = 0; i <= x; i++)
+						{
+							e.bytes({0x0F, 0xB7, 0x46, INDEX, 0x8A, 0x4E, i, 0x88, 0x4C, 0x07, i});
+						}
+						if(quirks.load_store_increments_index)
+						{
+							e.bytes({0x66, 0x83, 0x46, INDEX, (uint8_t)(x + 1)});
+						}
+					}return true;
+				}
+			}break;
+		}
+
+		return false;
+	}
+}
+
+Chip8Jit::Chip8Jit(Chip8JitQuirks quirks, InterpretFunction interpret)
+	:quirks(quirks), interpret(interpret), code_buffer(nullptr), code_size(0), code_used(0), code_executable(false), failed(false),
+	pending_write(0)
+{
+#ifndef CHIP8_JIT_SUPPORTED
+	failed = true;
+#endif
+
+	std::memset(blocks, 0, sizeof(blocks));
+	std::memset(compiled_memory, 0, sizeof(compiled_memory));
+}
+
+Chip8Jit::~Chip8Jit()
+{
+#ifdef CHIP8_JIT_SUPPORTED
+	if(code_buffer)
+	{
+		munmap(code_buffer, code_size);
+	}
+#endif
+}
+
+bool Chip8Jit::available() const
+{
+	return !failed;
+}
+
+bool Chip8Jit::protect(bool executable)
+{
+#ifdef CHIP8_JIT_SUPPORTED
+	if(failed)
+	{
+		return false;
+	}
+
+	if(!code_buffer)
+	{
+		//nothing is mapped until a machine actually compiles something, and then writable only
+		void* buffer = mmap(nullptr, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(buffer == MAP_FAILED)
+		{
+			failed = true;
+			return false;
+		}
+		code_buffer = static_cast<uint8_t*>(buffer);
+		code_size = JIT_BUFFER_SIZE;
+		code_executable = false;
+	}
+
+	if(code_executable != executable)
+	{
+		if(mprotect(code_buffer, code_size, executable ? PROT_READ | PROT_EXEC : PROT_READ | PROT_WRITE) != 0)
+		{
+			failed = true;
+			return false;
+		}
+		code_executable = executable;
+	}
+
+	return true;
+#else
+	(void)executable;
+	return false;
+#endif
+}
+
+bool Chip8Jit::prepare(Chip8State const& state)
+{
+	if(failed)
+	{
+		return false;
+	}
+
+	Block& block = blocks[state.pc];
+	if(!block.compiled)
+	{
+		compile(state.pc, state.memory, block);
+	}
+
+	//nothing to run, so no need to make the buffer executable yet
+	return block.size == 0 || protect(true);
+}
+
+void Chip8Jit::compile(uint16_t pc, uint8_t const* memory, Block& block)
+{
+	block.compiled = true;
+	block.size = 0;
+	block.offset = 0;
+
+	if(!protect(false))
+	{
+		return;
+	}
+
+	//make sure a whole block always fits so emitting never has to stop half way
+	if(code_used + MAX_BLOCK_LENGTH * MAX_INSTRUCTION_BYTES + BLOCK_OVERHEAD_BYTES > code_size)
+	{
+		flush();
+		//flush cleared the block being compiled along with the rest
+		block.compiled = true;
+	}
+
+	//an empty block still depends on the instruction that stopped it
+	markCompiled(pc, 2);
+
+	Emitter e = {code_buffer + code_used, 0};
+	//instructions run to get to address, the budget is checked against it before each one
+	unsigned int executed = 0;
+	bool terminated = false;
+	e.prologue();
+
+	uint16_t address = pc;
+	while(address + 1U < MEMORY_SIZE)
+	{
+		//bytes compiled so far, address only ever moves forward from pc
+		unsigned int offset = address - pc;
+		if(offset >= MAX_BLOCK_LENGTH * 2U)
+		{
+			break;
+		}
+
+		uint16_t opcode = (memory[address] << 8U) | memory[address + 1];
+		uint16_t next = address + 2;
+		size_t start = e.used;
+		if(executed > 0)
+		{
+			e.checkBudget(executed, address);
+		}
+
+		if(emitStraight(e, opcode, quirks))
+		{
+			executed++;
+			address = next;
+			continue;
+		}
+
+		//a skip over a jump, call or return is how CHIP-8 branches. The jump leaves the block and
+		//skipping it carries on in the same block: cmp; jcc skipped; the jump; epilogue; skipped:
+		uint8_t cmov;
+		if(next + 3U < MEMORY_SIZE && offset + 4U <= MAX_BLOCK_LENGTH * 2U
+			&& isJump((memory[next] << 8U) | memory[next + 1]) && emitSkipTest(e, opcode, cmov))
+		{
+			e.bytes({0x0F, (uint8_t)(cmov + 0x40)});
+			size_t skipped = e.used;
+			e.value(0, 4);
+
+			e.checkBudget(executed + 1, next);
+			emitTerminator(e, (memory[next] << 8U) | memory[next + 1], next + 2, quirks, &pending_write);
+			e.epilogue(executed + 2);
+
+			uint32_t distance = e.used - (skipped + 4);
+			std::memcpy(e.out + skipped, &distance, 4);
+			executed++;
+			address = next + 2;
+			continue;
+		}
+
+		if(emitTerminator(e, opcode, next, quirks, &pending_write))
+		{
+			executed++;
+			address = next;
+			terminated = true;
+			break;
+		}
+
+		//a block never starts with one of these, stepping the interpreter directly costs less than two calls
+		if(executed > 0 && interpretedInBlock(opcode))
+		{
+			e.setPc(next);
+			e.interpret(interpret, opcode);
+			executed++;
+			address = next;
+			//Fx0A leaves pc on itself until a key is down
+			if((opcode & 0xF0FFU) == 0xF00AU)
+			{
+				terminated = true;
+				break;
+			}
+			continue;
+		}
+
+		//the interpreter runs this one on the next step
+		e.used = start;
+		break;
+	}
+
+	if(executed == 0)
+	{
+		return;
+	}
+
+	if(!terminated)
+	{
+		//stopped before an instruction left to the interpreter, the end of memory or the block size limit
+		e.setPc(address);
+	}
+
+	e.epilogue(executed);
+	block.size = address - pc;
+	block.offset = code_used;
+	code_used += e.used;
+	markCompiled(pc, block.size);
+}
+
+void Chip8Jit::markCompiled(uint16_t address, unsigned int length)
+{
+	for(unsigned int i = address; i < address + length && i < MEMORY_SIZE; i++)
+	{
+		compiled_memory[i / 64U] |= 1ULL << (i % 64U);
+	}
+}
+
+void Chip8Jit::invalidate(uint16_t address, uint16_t length)
+{
+	//most writes are to data, which no block was compiled from
+	bool compiled = false;
+	for(unsigned int i = address; i < (unsigned int)address + length && i < MEMORY_SIZE; i++)
+	{
+		if(compiled_memory[i / 64U] & (1ULL << (i % 64U)))
+		{
+			compiled = true;
+			break;
+		}
+	}
+	if(!compiled)
+	{
+		return;
+	}
+
+	//a block starting up to MAX_BLOCK_LENGTH instructions before the write may cover it
+	int first = (int)address - (int)(MAX_BLOCK_LENGTH * 2) + 1;
+	int last = (int)address + length - 1;
+	if(first < 0)
+	{
+		first = 0;
+	}
+	if(last >= (int)MEMORY_SIZE)
+	{
+		last = MEMORY_SIZE - 1;
+	}
+
+	for(int start = first; start <= last; start++)
+	{
+		Block& block = blocks[start];
+		//an empty block still depends on the instruction that stopped it
+		int covered = block.size > 0 ? block.size : 2;
+		if(block.compiled && start + covered > address)
+		{
+			//the code stays in the buffer until the next flush, it is simply never called again
+			block.compiled = false;
+		}
+	}
+}
+
+void Chip8Jit::flush()
+{
+	std::memset(blocks, 0, sizeof(blocks));
+	std::memset(compiled_memory, 0, sizeof(compiled_memory));
+	code_used = 0;
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+#include "chip-8.h"
+#include <cstddef>
+#include <cstdint>
+
+//the quirks of the machine the blocks run on, see VipQuirks
+struct Chip8JitQuirks
+{
+	bool shift_uses_vy;
+	bool logic_resets_vf;
+	bool jump_uses_vx;
+	bool load_store_increments_index;
+};
+
+//Translates basic blocks of CHIP-8 code into x86-64.
+//A block runs register, index, timer, random and load instructions natively, calls back into the interpreter for
+//drawing and the other instructions that leave pc alone, and ends with the jump, call, return, skip, Fx0A, Fx33 or
+//Fx55 after them, which it runs too and sets pc from. A skip over a jump branches inside the block instead.
+//Blocks check the instruction budget as they go, so they can stop anywhere a frame ends.
+//The code buffer is mapped on the first compile and is never writable and executable at the same time.
+class Chip8Jit
+{
+public:
+
+	//runs one instruction for a block, with pc already past it
+	typedef void(*InterpretFunction)(Chip8State& state, uint16_t opcode);
+
+	Chip8Jit(Chip8JitQuirks quirks, InterpretFunction interpret);
+	~Chip8Jit();
+
+	//false once executable memory could not be mapped or protected, every run() then returns 0
+	bool available() const;
+
+	//runs at most maxInstructions of the block starting at state.pc, compiling it first if needed, and leaves pc
+	//where execution stopped. returns the number of instructions executed, 0 if there is no block at pc
+	unsigned int run(Chip8State& state, unsigned int maxInstructions);
+
+	//drops every block overlapping memory[address] to memory[address + length - 1]
+	void invalidate(uint16_t address, uint16_t length);
+
+private:
+
+	//gets the instruction budget, always at least 1, and returns how many instructions it ran
+	typedef unsigned int(*BlockFunction)(Chip8State* state, unsigned int maxInstructions);
+
+	struct Block
+	{
+		uint32_t offset; //where the code starts in code_buffer
+		uint8_t size; //bytes of CHIP-8 code the block was compiled from, 0 when the first instruction can't be compiled
+		bool compiled;
+	};
+
+	//compiles the block at state.pc if needed and makes the buffer executable, the slow path of run()
+	bool prepare(Chip8State const& state);
+
+	void compile(uint16_t pc, uint8_t const* memory, Block& block);
+
+	//notes that blocks were compiled from memory[address] to memory[address + length - 1]
+	void markCompiled(uint16_t address, unsigned int length);
+
+	//maps the code buffer on first use, then flips it between writable and executable
+	bool protect(bool executable);
+
+	//forgets every block and starts filling the code buffer from the beginning
+	void flush();
+
+	Chip8JitQuirks quirks;
+	InterpretFunction interpret;
+
+	uint8_t* code_buffer;
+	size_t code_size;
+	size_t code_used;
+	bool code_executable;
+	bool failed;
+
+	//address | length << 16 of the last Fx33 or Fx55 store a block ran, 0 once run() has dropped the blocks it overwrote
+	uint32_t pending_write;
+
+	//one entry per address, ROMs are free to jump to odd ones
+	Block blocks[MEMORY_SIZE];
+	//a bit per address, set once a block has been compiled from it. Cleared only by flush,
+	//so a write to an address no block ever covered skips the search through blocks
+	uint64_t compiled_memory[MEMORY_SIZE / 64];
+};
+
+inline unsigned int Chip8Jit::run(Chip8State& state, unsigned int maxInstructions)
+{
+	if(state.pc >= MEMORY_SIZE || maxInstructions == 0)
+	{
+		return 0;
+	}
+
+	//kept inline since most steps find their block compiled and the buffer executable
+	Block const& block = blocks[state.pc];
+	if((!block.compiled || !code_executable) && !prepare(state))
+	{
+		return 0;
+	}
+	if(block.size == 0)
+	{
+		return 0;
+	}
+
+	unsigned int executed = reinterpret_cast<BlockFunction>(code_buffer + block.offset)(&state, maxInstructions);
+
+	if(pending_write != 0)
+	{
+		//the same range op_Fx33 and op_Fx55 hand to invalidateCode
+		invalidate(pending_write & 0xFFFFU, pending_write >> 16U);
+		pending_write = 0;
+	}
+
+	return executed;
+}
@@ -0,0 +1,644 @@
+#include "lockstep.h"
+#include <cstring>
+
+const uint16_t ADDRESS_MASK = MEMORY_SIZE - 1;
+
+//the lane loops below are written without branches on the mask so they vectorize,
+//a mask byte is 0xFF for a lane that runs the instruction and 0 for one that keeps its old value
+static inline uint8_t select(uint8_t mask, uint8_t value, uint8_t old)
+{
+	return (value & mask) | (old & ~mask);
+}
+
+static inline uint16_t select(uint8_t mask, uint16_t value, uint16_t old)
+{
+	uint16_t wide = (uint16_t)(int16_t)(int8_t)mask;
+	return (value & wide) | (old & ~wide);
+}
+
+static inline uint8_t boolMask(bool condition)
+{
+	return condition ? 0xFFU : 0x00U;
+}
+
+Chip8Lockstep::Chip8Lockstep()
+{
+	std::memset(memory, 0, sizeof(memory));
+	std::memset(regesters, 0, sizeof(regesters));
+	std::memset(pc, 0, sizeof(pc));
+	std::memset(index_regester, 0, sizeof(index_regester));
+	std::memset(stack, 0, sizeof(stack));
+	std::memset(stack_pointer, 0, sizeof(stack_pointer));
+	std::memset(display, 0, sizeof(display));
+	std::memset(keypad, 0, sizeof(keypad));
+	std::memset(sound_timer, 0, sizeof(sound_timer));
+	std::memset(delay_timer, 0, sizeof(delay_timer));
+	std::memset(sound_timer_start, 0, sizeof(sound_timer_start));
+	std::memset(delay_timer_start, 0, sizeof(delay_timer_start));
+	std::memset(timer_ticks, 0, sizeof(timer_ticks));
+	std::memset(instruction_count, 0, sizeof(instruction_count));
+	std::memset(active, 0, sizeof(active));
+	std::memset(rng_state, 0, sizeof(rng_state));
+
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		draw_policy[lane] = Chip8DrawPolicy::Clip;
+	}
+
+	step_count = 0;
+	divergent_steps = 0;
+}
+
+void Chip8Lockstep::loadLane(unsigned int lane, Chip8 const& source)
+{
+	for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+	{
+		memory[address][lane] = source.memory[address];
+	}
+	for(unsigned int i = 0; i < NUM_REGESTERS; i++)
+	{
+		regesters[i][lane] = source.regesters[i];
+	}
+	for(unsigned int i = 0; i < STACK_SIZE; i++)
+	{
+		stack[i][lane] = source.stack[i];
+	}
+	for(unsigned int row = 0; row < DISPLAY_HIGHT; row++)
+	{
+		display[row][lane] = source.display[row][0];
+	}
+	for(unsigned int key = 0; key < NUM_KEYS; key++)
+	{
+		keypad[key][lane] = source.keypad[key];
+	}
+
+	pc[lane] = source.pc;
+	index_regester[lane] = source.index_regester;
+	stack_pointer[lane] = source.stack_pointer;
+	sound_timer[lane] = source.sound_timer;
+	delay_timer[lane] = source.delay_timer;
+	sound_timer_start[lane] = source.sound_timer_start;
+	delay_timer_start[lane] = source.delay_timer_start;
+	timer_ticks[lane] = source.timer_ticks;
+	instruction_count[lane] = source.instruction_count;
+	draw_policy[lane] = source.draw_policy;
+	rng_state[lane] = source.rng_state;
+
+	active[lane] = 0xFFU;
+}
+
+void Chip8Lockstep::storeLane(unsigned int lane, Chip8& destination) const
+{
+	for(unsigned int address = 0; address < MEMORY_SIZE; address++)
+	{
+		destination.memory[address] = memory[address][lane];
+	}
+	for(unsigned int i = 0; i < NUM_REGESTERS; i++)
+	{
+		destination.regesters[i] = regesters[i][lane];
+	}
+	for(unsigned int i = 0; i < STACK_SIZE; i++)
+	{
+		destination.stack[i] = stack[i][lane];
+	}
+	for(unsigned int row = 0; row < DISPLAY_HIGHT; row++)
+	{
+		destination.display[row][0] = display[row][lane];
+	}
+	for(unsigned int key = 0; key < NUM_KEYS; key++)
+	{
+		destination.keypad[key] = keypad[key][lane];
+	}
+
+	destination.pc = pc[lane];
+	destination.index_regester = index_regester[lane];
+	destination.stack_pointer = stack_pointer[lane];
+	destination.sound_timer = sound_timer[lane];
+	destination.delay_timer = delay_timer[lane];
+	destination.sound_timer_start = sound_timer_start[lane];
+	destination.delay_timer_start = delay_timer_start[lane];
+	destination.timer_ticks = timer_ticks[lane];
+	destination.instruction_count = instruction_count[lane];
+	destination.draw_policy = draw_policy[lane];
+	destination.rng_state = rng_state[lane];
+
+	//the whole machine may have changed under the destination's caches and frontend
+	destination.invalidateCode(0, MEMORY_SIZE);
+	destination.dirty_rows = 0xFFFFFFFFFFFFFFFFULL;
+	destination.frame_generation++;
+}
+
+void Chip8Lockstep::clearLane(unsigned int lane)
+{
+	active[lane] = 0;
+}
+
+unsigned int Chip8Lockstep::lanes() const
+{
+	unsigned int count = 0;
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		count += active[lane] & 0x1U;
+	}
+	return count;
+}
+
+uint64_t Chip8Lockstep::steps() const
+{
+	return step_count;
+}
+
+uint64_t Chip8Lockstep::divergentSteps() const
+{
+	return divergent_steps;
+}
+
+uint8_t Chip8Lockstep::delayTimer(unsigned int lane) const
+{
+	uint64_t elapsed = timer_ticks[lane] - delay_timer_start[lane];
+	return elapsed >= delay_timer[lane] ? 0 : delay_timer[lane] - elapsed;
+}
+
+void Chip8Lockstep::runFrame(unsigned int instructionsPerFrame)
+{
+	for(unsigned int i = 0; i < instructionsPerFrame; i++)
+	{
+		step();
+	}
+
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		timer_ticks[lane]++;
+	}
+}
+
+void Chip8Lockstep::step()
+{
+	unsigned int first = 0;
+	while(first < LOCKSTEP_LANES && !active[first])
+	{
+		first++;
+	}
+	if(first == LOCKSTEP_LANES)
+	{
+		return;
+	}
+	step_count++;
+
+	//the common case, every lane is at the same pc and sees the same opcode there
+	uint16_t leader_pc = pc[first];
+	uint8_t differ = 0;
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		differ |= boolMask(pc[lane] != leader_pc) & active[lane];
+	}
+	if(!differ)
+	{
+		uint8_t const* high = memory[leader_pc & ADDRESS_MASK];
+		uint8_t const* low = memory[(leader_pc + 1) & ADDRESS_MASK];
+		for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+		{
+			differ |= ((high[lane] ^ high[first]) | (low[lane] ^ low[first])) & active[lane];
+		}
+		if(!differ)
+		{
+			execute(Chip8::decode((high[first] << 8U) | low[first]), active);
+			return;
+		}
+	}
+
+	//lanes have split up, fetch every lane's opcode before any of them runs
+	//then run each group of lanes sharing an opcode under its own mask
+	divergent_steps++;
+
+	uint16_t opcodes[LOCKSTEP_LANES];
+	uint8_t waiting[LOCKSTEP_LANES];
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		opcodes[lane] = (memory[pc[lane] & ADDRESS_MASK][lane] << 8U) | memory[(pc[lane] + 1) & ADDRESS_MASK][lane];
+		waiting[lane] = active[lane];
+	}
+
+	for(unsigned int leader = first; leader < LOCKSTEP_LANES; leader++)
+	{
+		if(!waiting[leader])
+		{
+			continue;
+		}
+
+		alignas(64) uint8_t group[LOCKSTEP_LANES];
+		for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+		{
+			group[lane] = waiting[lane] & boolMask(opcodes[lane] == opcodes[leader]);
+			waiting[lane] &= ~group[lane];
+		}
+
+		execute(Chip8::decode(opcodes[leader]), group);
+	}
+}
+
+void Chip8Lockstep::execute(Chip8Instruction const& instruction, uint8_t const* mask)
+{
+	uint8_t x = instruction.x;
+	uint8_t y = instruction.y;
+	uint8_t kk = instruction.kk;
+	uint16_t nnn = instruction.nnn;
+
+	uint8_t* Vx = regesters[x];
+	uint8_t* Vy = regesters[y];
+	uint8_t* VF = regesters[0xF];
+
+	for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+	{
+		pc[lane] += 2 & (uint16_t)(int16_t)(int8_t)mask[lane];
+		instruction_count[lane] += mask[lane] & 0x1U;
+	}
+
+	//the order of the regester writes follows the Chip8 handlers exactly, including which of
+	//VF and Vx is written first, so x or y being F gives the same result
+	switch(instruction.handler)
+	{
+		case OP_00E0:
+		{
+			for(unsigned int row = 0; row < DISPLAY_HIGHT; row++)
+			{
+				for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+				{
+					display[row][lane] &= ~(uint64_t)(int64_t)(int8_t)mask[lane];
+				}
+			}
+		}break;
+
+		case OP_00EE:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					--stack_pointer[lane];
+					pc[lane] = stack[stack_pointer[lane] % STACK_SIZE][lane];
+				}
+			}
+		}break;
+
+		case OP_1nnn:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane], nnn, pc[lane]);
+			}
+		}break;
+
+		case OP_2nnn:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					stack[stack_pointer[lane] % STACK_SIZE][lane] = pc[lane];
+					++stack_pointer[lane];
+					pc[lane] = nnn;
+				}
+			}
+		}break;
+
+		case OP_3xkk:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane] & boolMask(Vx[lane] == kk), (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_4xkk:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane] & boolMask(Vx[lane] != kk), (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_5xy0:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane] & boolMask(Vx[lane] == Vy[lane]), (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_6xkk:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], kk, Vx[lane]);
+			}
+		}break;
+
+		case OP_7xkk:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] + kk), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy0:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], Vy[lane], Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy1:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] | Vy[lane]), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy2:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] & Vy[lane]), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy3:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] ^ Vy[lane]), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy4:
+		{
+			//op_8xy4 writes the carry after Vx
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				unsigned int sum = Vx[lane] + Vy[lane];
+				uint8_t flag = sum > 0xFFU ? 1 : 0;
+				Vx[lane] = select(mask[lane], (uint8_t)sum, Vx[lane]);
+				VF[lane] = select(mask[lane], flag, VF[lane]);
+			}
+		}break;
+
+		case OP_8xy5:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint8_t difference = Vx[lane] - Vy[lane];
+				uint8_t flag = Vx[lane] > Vy[lane] ? 1 : 0;
+				VF[lane] = select(mask[lane], flag, VF[lane]);
+				Vx[lane] = select(mask[lane], difference, Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy6:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				VF[lane] = select(mask[lane], (uint8_t)(Vx[lane] & 0x1U), VF[lane]);
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] >> 1U), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xy7:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint8_t flag = Vy[lane] > Vx[lane] ? 1 : 0;
+				VF[lane] = select(mask[lane], flag, VF[lane]);
+				Vx[lane] = select(mask[lane], (uint8_t)(Vy[lane] - Vx[lane]), Vx[lane]);
+			}
+		}break;
+
+		case OP_8xyE:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				VF[lane] = select(mask[lane], (uint8_t)((Vx[lane] & 0x80U) >> 7U), VF[lane]);
+				Vx[lane] = select(mask[lane], (uint8_t)(Vx[lane] << 1U), Vx[lane]);
+			}
+		}break;
+
+		case OP_9xy0:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane] & boolMask(Vx[lane] != Vy[lane]), (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_Annn:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				index_regester[lane] = select(mask[lane], nnn, index_regester[lane]);
+			}
+		}break;
+
+		case OP_Bnnn:
+		{
+			uint8_t* V0 = regesters[0];
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				pc[lane] = select(mask[lane], (uint16_t)(nnn + V0[lane]), pc[lane]);
+			}
+		}break;
+
+		case OP_Cxkk:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint64_t state = rng_state[lane];
+				uint8_t byte = chip8RandomByte(state) & kk;
+				uint64_t wide = (uint64_t)(int64_t)(int8_t)mask[lane];
+				rng_state[lane] = (state & wide) | (rng_state[lane] & ~wide);
+				Vx[lane] = select(mask[lane], byte, Vx[lane]);
+			}
+		}break;
+
+		case OP_Dxyn:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(!mask[lane])
+				{
+					continue;
+				}
+
+				uint8_t x_coordinate = Vx[lane] % DISPLAY_WIDTH;
+				uint8_t y_coordinate = Vy[lane] % DISPLAY_HIGHT;
+				uint16_t sprite_address = index_regester[lane];
+				VF[lane] = 0;
+
+				for(unsigned int row = 0; row < instruction.n; row++)
+				{
+					unsigned int screen_row = y_coordinate + row;
+					if(screen_row >= DISPLAY_HIGHT)
+					{
+						if(draw_policy[lane] == Chip8DrawPolicy::Clip)
+						{
+							break;
+						}
+						screen_row -= DISPLAY_HIGHT;
+					}
+
+					uint64_t sprite_byte = (uint64_t)memory[(sprite_address + row) & ADDRESS_MASK][lane] << (DISPLAY_WIDTH - 8U);
+					uint64_t sprite_row = sprite_byte >> x_coordinate;
+					if(draw_policy[lane] == Chip8DrawPolicy::Wrap && x_coordinate > 0)
+					{
+						sprite_row |= sprite_byte << (DISPLAY_WIDTH - x_coordinate);
+					}
+
+					if(display[screen_row][lane] & sprite_row)
+					{
+						VF[lane] = 1;
+					}
+					display[screen_row][lane] ^= sprite_row;
+				}
+			}
+		}break;
+
+		case OP_Ex9E:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint8_t pressed = boolMask(keypad[Vx[lane] % NUM_KEYS][lane]);
+				pc[lane] = select(mask[lane] & pressed, (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_ExA1:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint8_t pressed = boolMask(keypad[Vx[lane] % NUM_KEYS][lane]);
+				pc[lane] = select(mask[lane] & ~pressed, (uint16_t)(pc[lane] + 2), pc[lane]);
+			}
+		}break;
+
+		case OP_Fx07:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Vx[lane] = select(mask[lane], delayTimer(lane), Vx[lane]);
+			}
+		}break;
+
+		case OP_Fx0A:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(!mask[lane])
+				{
+					continue;
+				}
+
+				unsigned int key = 0;
+				while(key < NUM_KEYS && !keypad[key][lane])
+				{
+					key++;
+				}
+
+				if(key < NUM_KEYS)
+				{
+					Vx[lane] = key;
+				}
+				else
+				{
+					pc[lane] -= 2;
+				}
+			}
+		}break;
+
+		case OP_Fx15:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					delay_timer[lane] = Vx[lane];
+					delay_timer_start[lane] = timer_ticks[lane];
+				}
+			}
+		}break;
+
+		case OP_Fx18:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					sound_timer[lane] = Vx[lane];
+					sound_timer_start[lane] = timer_ticks[lane];
+				}
+			}
+		}break;
+
+		case OP_Fx1E:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				index_regester[lane] = select(mask[lane], (uint16_t)(index_regester[lane] + Vx[lane]), index_regester[lane]);
+			}
+		}break;
+
+		case OP_Fx29:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				uint16_t sprite = FONT_START_ADDRESS + Vx[lane] * 5;
+				index_regester[lane] = select(mask[lane], sprite, index_regester[lane]);
+			}
+		}break;
+
+		case OP_Fx33:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					uint16_t address = index_regester[lane];
+					memory[(address + 2) & ADDRESS_MASK][lane] = Vx[lane] % 10;
+					memory[(address + 1) & ADDRESS_MASK][lane] = (Vx[lane] / 10) % 10;
+					memory[address & ADDRESS_MASK][lane] = (Vx[lane] / 100) % 10;
+				}
+			}
+		}break;
+
+		case OP_Fx55:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					for(unsigned int i = 0; i <= x; i++)
+					{
+						memory[(index_regester[lane] + i) & ADDRESS_MASK][lane] = regesters[i][lane];
+					}
+				}
+			}
+		}break;
+
+		case OP_Fx65:
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				if(mask[lane])
+				{
+					for(unsigned int i = 0; i <= x; i++)
+					{
+						regesters[i][lane] = memory[(index_regester[lane] + i) & ADDRESS_MASK][lane];
+					}
+				}
+			}
+		}break;
+
+		default: break;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "chip-8.h"
+#include <cstdint>
+
+//number of machines a Chip8Lockstep runs side by side, 32 byte lanes fill one AVX2 register
+const unsigned int LOCKSTEP_LANES = 32;
+
+//Runs up to LOCKSTEP_LANES copies of a Chip8 in lockstep, for stepping many runs of the same ROM with different input.
+//State is kept structure-of-arrays, one entry per lane for every regester and memory byte, so an instruction
+//all the lanes agree on runs as a few loops over the lanes the compiler turns into SIMD with per lane masks.
+//When lanes end up at different instructions they are split into groups sharing an opcode and each group
+//runs masked in turn, so the results are the same as stepping each lane as its own Chip8
+class Chip8Lockstep
+{
+public:
+
+	Chip8Lockstep();
+
+	//copies a machine into a lane and makes the lane active, lanes start inactive
+	void loadLane(unsigned int lane, Chip8 const& source);
+	//copies a lane back out into a machine
+	void storeLane(unsigned int lane, Chip8& destination) const;
+	//stops running a lane
+	void clearLane(unsigned int lane);
+
+	//runs one instruction on every active lane and ticks no timers, like Chip8::cycle without the tick
+	void step();
+	//runs a batch of instructions on every active lane then ticks the timers once, like Chip8::runFrame
+	void runFrame(unsigned int instructionsPerFrame);
+
+	//number of active lanes
+	unsigned int lanes() const;
+	//steps so far, every active lane executes one instruction per step
+	uint64_t steps() const;
+	//steps where the active lanes weren't all on the same opcode
+	uint64_t divergentSteps() const;
+
+	//keypad[key][lane], set like Chip8::keypad
+	uint8_t keypad[NUM_KEYS][LOCKSTEP_LANES];
+
+private:
+
+	//runs one decoded instruction on the lanes where mask is 0xFF
+	void execute(Chip8Instruction const& instruction, uint8_t const* mask);
+
+	uint8_t delayTimer(unsigned int lane) const;
+
+	//addresses wrap at MEMORY_SIZE so each lane stays inside its own column
+	alignas(64) uint8_t memory[MEMORY_SIZE][LOCKSTEP_LANES];
+	alignas(64) uint8_t regesters[NUM_REGESTERS][LOCKSTEP_LANES];
+	alignas(64) uint16_t pc[LOCKSTEP_LANES];
+	alignas(64) uint16_t index_regester[LOCKSTEP_LANES];
+	alignas(64) uint16_t stack[STACK_SIZE][LOCKSTEP_LANES];
+	alignas(64) uint8_t stack_pointer[LOCKSTEP_LANES];
+	alignas(64) uint64_t display[DISPLAY_HIGHT][LOCKSTEP_LANES];
+
+	uint8_t sound_timer[LOCKSTEP_LANES];
+	uint8_t delay_timer[LOCKSTEP_LANES];
+	uint64_t sound_timer_start[LOCKSTEP_LANES];
+	uint64_t delay_timer_start[LOCKSTEP_LANES];
+	uint64_t timer_ticks[LOCKSTEP_LANES];
+	uint64_t instruction_count[LOCKSTEP_LANES];
+
+	Chip8DrawPolicy draw_policy[LOCKSTEP_LANES];
+	uint64_t rng_state[LOCKSTEP_LANES];
+
+	//0xFF for lanes that run, 0 otherwise
+	alignas(64) uint8_t active[LOCKSTEP_LANES];
+
+	uint64_t step_count;
+	uint64_t divergent_steps;
+};
@@ -1,58 +1,162 @@
 #include "chip-8.h"
+#include "framePacer.h"
 #include "gameWindow.h"
+#include "movie.h"
+#include "rewind.h"
 #include <chrono>
 #include <iostream>
+#include <memory>
+#include <string>
+#include <variant>
 
 int main(int argc, char** argv)
 {	
 	//If given an invalid argument count exit
-	if(argc != 4)
+	if(argc < 4)
 	{
+		std::cerr << "usage: " << argv[0] << " <video scale> <instructions per second> <rom> [vsync] [seed <n>] [quirks <vip|schip|modern>] [record <movie>]" << std::endl;
 		return -1;
 	}
 
 	//load in arguments as variables
 	int videoScale = std::stoi(argv[1]);
-	int cycleDelay = std::stoi(argv[2]);
+	long instructionsPerSecond = std::stol(argv[2]);
 	char const* fileName = argv[3];
+	bool vsync = false;
+	char const* movieName = nullptr;
+	//the seed is recorded so a movie replays the same random numbers
+	uint64_t seed = std::chrono::system_clock::now().time_since_epoch().count();
+	//the ROM's sidecar or extension unless overridden
+	Chip8Quirks quirks = chip8QuirksForRom(fileName);
+	for(int i = 4; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if(arg == "vsync")
+		{
+			vsync = true;
+		}
+		else if(arg == "seed" && i + 1 < argc)
+		{
+			seed = std::stoull(argv[++i]);
+		}
+		else if(arg == "quirks" && i + 1 < argc)
+		{
+			if(!parseChip8Quirks(argv[++i], quirks))
+			{
+				std::cerr << "unknown quirks " << argv[i] << std::endl;
+				return -1;
+			}
+		}
+		else if(arg == "record" && i + 1 < argc)
+		{
+			movieName = argv[++i];
+		}
+		else
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return -1;
+		}
+	}
 	
-	//Create Game window
-	GameWindow Window(fileName, DISPLAY_WIDTH * videoScale, DISPLAY_HIGHT * videoScale, DISPLAY_WIDTH, DISPLAY_HIGHT);
-	
-	//create CHIP-8
-	Chip8 Chip8_Emulator;
-	Chip8_Emulator.loadROM(fileName);
-	
-	int videoPitch = sizeof(Chip8_Emulator.display[0]) * DISPLAY_WIDTH;
+	//create CHIP-8 with the quirks the ROM was written for, the emulation loop is compiled once per quirk set
+	std::unique_ptr<Chip8Variant> machine = createChip8(quirks);
+	return std::visit([&](auto& Chip8_Emulator)
+	{
+		if(!Chip8_Emulator.loadROM(fileName))
+		{
+			std::cerr << "could not load " << fileName << ", ROMs can be at most " << MAX_ROM_SIZE << " bytes" << std::endl;
+			return -1;
+		}
+
+		//Create Game window
+		GameWindow Window(fileName, DISPLAY_WIDTH * videoScale, DISPLAY_HIGHT * videoScale, DISPLAY_WIDTH, DISPLAY_HIGHT, vsync);
+
+		Chip8_Emulator.seed(seed);
+		Chip8Movie movie;
+		movie.record(seed, instructionsPerSecond, quirks);
 
-	//set condition variable to false and set now to be the time of the first cycle	
-	auto lastcycle = std::chrono::high_resolution_clock::now();
-	bool quit = false;
+		//last minute of frames, holding backspace plays them backwards
+		Chip8Rewind history;
+		history.push(Chip8_Emulator);
+		bool rewinding = false;
 	
-	//emulation loop
-	while(!quit)
-	{
+		//the core keeps one bit per pixel, this is the RGBA copy handed to the window, big enough for hi-res
+		uint32_t pixels[HIRES_DISPLAY_WIDTH * HIRES_DISPLAY_HIGHT];
 
-		//if signaled to quit exit
-		quit = Window.processInput(Chip8_Emulator.keypad);
+		//one frame per timer tick
+		FramePacer pacer(TIMER_FREQUENCY);
+		//frames run so far, rewinding counts back down
+		uint64_t frame = 0;
+		unsigned int framesDue = 1;
+		bool quit = false;
 	
-		//get the current time and find the difference since we set the fist cycle	
-		auto currentTime = std::chrono::high_resolution_clock::now();
-		float delta_t = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastcycle).count();
-		
-		//if the change in time is greater that the delay set then run a cycle	
-		if(delta_t > cycleDelay)
+		//emulation loop
+		while(!quit)
 		{
 			
-	//		Chip8_Emulator.printState();
+//			Chip8_Emulator.printState();
 
-			lastcycle = currentTime;
-			
-			Chip8_Emulator.cycle();
-			
-			Window.Update(Chip8_Emulator.display, videoPitch);
-		}		
-	}	
-	
-	return 0; 
+			//if signaled to quit exit
+			quit = Window.processInput(Chip8_Emulator.keypad, rewinding);
+
+			//usually one, with vsync the refreshes can bring none or several
+			for(unsigned int i = 0; i < framesDue; i++)
+			{
+				if(rewinding)
+				{
+					//restoring also marks every row dirty so the old screen gets uploaded.
+					//the recording forgets the frame too, so the movie follows the new timeline
+					if(history.stepBack(Chip8_Emulator))
+					{
+						if(movieName)
+						{
+							movie.undoFrame(Chip8_Emulator);
+						}
+						frame--;
+					}
+				}
+				else
+				{
+					if(movieName)
+					{
+						movie.recordFrame(Chip8_Emulator);
+					}
+					Chip8_Emulator.runFrame(chip8InstructionsForFrame(instructionsPerSecond, frame));
+					history.push(Chip8_Emulator);
+					frame++;
+				}
+			}
+		
+			//only rows changed during the frame are converted and uploaded, SUPER-CHIP ROMs can switch resolution at any time
+			uint64_t dirtyRows = Chip8_Emulator.takeDirtyRows();
+			int videoWidth = Chip8_Emulator.displayWidth();
+			Chip8_Emulator.renderRGBA(pixels, dirtyRows);
+			bool presented = Window.Update(pixels, sizeof(pixels[0]) * videoWidth, videoWidth, Chip8_Emulator.displayHight(), dirtyRows);
+
+			//with vsync the present already waited for the display refresh, so the refreshes drive the loop and the pacer
+			//only counts the frames that came due. otherwise, or when nothing was presented, sleep until the next frame is due
+			if(presented && Window.vsync())
+			{
+				framesDue = pacer.framesDue();
+			}
+			else
+			{
+				pacer.wait();
+				framesDue = 1;
+			}
+		}	
+
+		pacer.printStatistics(std::cout);
+
+		if(movieName)
+		{
+			movie.finish(Chip8_Emulator);
+			if(!movie.write(movieName))
+			{
+				std::cerr << "could not write " << movieName << std::endl;
+			}
+		}
+
+		return 0;
+	}, *machine);
 }
@@ -0,0 +1,302 @@
+#include "movie.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+//identifies movie files, followed by the version
+const char MOVIE_MAGIC[4] = {'C', '8', 'M', 'V'};
+
+template<typename T>
+static void writeValue(std::ofstream& file, T const& value)
+{
+	file.write(reinterpret_cast<char const*>(&value), sizeof(value));
+}
+
+template<typename T>
+static void readValue(std::ifstream& file, T& value)
+{
+	file.read(reinterpret_cast<char*>(&value), sizeof(value));
+}
+
+Chip8Movie::Chip8Movie()
+{
+	record(0, 0);
+}
+
+void Chip8Movie::record(uint64_t seed, uint32_t instructionsPerSecond, Chip8Quirks quirks, uint32_t keyframeInterval)
+{
+	machine_quirks = quirks;
+	rng_seed = seed;
+	instructions_per_second = instructionsPerSecond;
+	keyframe_interval = keyframeInterval > 0 ? keyframeInterval : 1;
+	frame_count = 0;
+	final_instructions = 0;
+	final_display_hash = 0;
+	inputs.clear();
+	keyframes.clear();
+	std::memset(last_keypad, 0, sizeof(last_keypad));
+	play_frame = 0;
+	play_input = 0;
+}
+
+template<typename Quirks>
+void Chip8Movie::recordFrame(BasicChip8<Quirks> const& chip8)
+{
+	if(frame_count % keyframe_interval == 0)
+	{
+		keyframes.emplace_back();
+		Chip8MovieKeyframe& keyframe = keyframes.back();
+		keyframe.frame = frame_count;
+		keyframe.first_input = inputs.size();
+		chip8.saveState(keyframe.state);
+	}
+
+	for(unsigned int key = 0; key < NUM_KEYS; key++)
+	{
+		if(chip8.keypad[key] != last_keypad[key])
+		{
+			inputs.push_back({chip8.instructions(), frame_count, (uint8_t)key, chip8.keypad[key]});
+			last_keypad[key] = chip8.keypad[key];
+		}
+	}
+
+	frame_count++;
+}
+
+template<typename Quirks>
+void Chip8Movie::undoFrame(BasicChip8<Quirks> const& chip8)
+{
+	if(frame_count == 0)
+	{
+		return;
+	}
+	frame_count--;
+
+	while(!inputs.empty() && inputs.back().frame >= frame_count)
+	{
+		inputs.pop_back();
+	}
+	while(!keyframes.empty() && keyframes.back().frame >= frame_count)
+	{
+		keyframes.pop_back();
+	}
+
+	std::memcpy(last_keypad, chip8.keypad, sizeof(last_keypad));
+}
+
+template<typename Quirks>
+void Chip8Movie::finish(BasicChip8<Quirks> const& chip8)
+{
+	final_instructions = chip8.instructions();
+	final_display_hash = chip8.displayHash();
+}
+
+template<typename Quirks>
+bool Chip8Movie::seek(BasicChip8<Quirks>& chip8, uint32_t frame)
+{
+	if(Quirks::id != machine_quirks || frame > frame_count || keyframes.empty())
+	{
+		return false;
+	}
+
+	//a movie that ends exactly on a keyframe boundary has no keyframe for its last frame
+	size_t keyframe_index = std::min<size_t>(frame / keyframe_interval, keyframes.size() - 1);
+
+	Chip8MovieKeyframe const& keyframe = keyframes[keyframe_index];
+	chip8.loadState(keyframe.state);
+	play_frame = keyframe.frame;
+	play_input = keyframe.first_input;
+
+	while(play_frame < frame)
+	{
+		playFrame(chip8);
+	}
+	return true;
+}
+
+template<typename Quirks>
+bool Chip8Movie::playFrame(BasicChip8<Quirks>& chip8)
+{
+	if(play_frame >= frame_count)
+	{
+		return false;
+	}
+
+	//inputs are keyed by the instruction count the frame started at
+	while(play_input < inputs.size() && inputs[play_input].instruction <= chip8.instructions())
+	{
+		chip8.keypad[inputs[play_input].key] = inputs[play_input].pressed;
+		play_input++;
+	}
+
+	chip8.runFrame(chip8InstructionsForFrame(instructions_per_second, play_frame));
+	play_frame++;
+	return true;
+}
+
+bool Chip8Movie::write(char const* filename) const
+{
+	std::ofstream file(filename, std::ios_base::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	//header, then the inputs, then the keyframes, all in host byte order
+	file.write(MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+	writeValue(file, CHIP8_MOVIE_VERSION);
+	writeValue(file, (uint32_t)sizeof(Chip8Snapshot));
+	writeValue(file, (uint32_t)machine_quirks);
+	writeValue(file, rng_seed);
+	writeValue(file, instructions_per_second);
+	writeValue(file, keyframe_interval);
+	writeValue(file, frame_count);
+	writeValue(file, final_instructions);
+	writeValue(file, final_display_hash);
+	writeValue(file, (uint32_t)inputs.size());
+	writeValue(file, (uint32_t)keyframes.size());
+
+	for(auto const& input : inputs)
+	{
+		writeValue(file, input.instruction);
+		writeValue(file, input.frame);
+		writeValue(file, input.key);
+		writeValue(file, input.pressed);
+	}
+	for(auto const& keyframe : keyframes)
+	{
+		writeValue(file, keyframe.frame);
+		writeValue(file, keyframe.first_input);
+		writeValue(file, keyframe.state);
+	}
+	return file.good();
+}
+
+bool Chip8Movie::read(char const* filename)
+{
+	std::ifstream file(filename, std::ios_base::binary);
+	if(!file.is_open())
+	{
+		return false;
+	}
+
+	char magic[sizeof(MOVIE_MAGIC)];
+	uint32_t version = 0;
+	uint32_t snapshot_size = 0;
+	file.read(magic, sizeof(magic));
+	readValue(file, version);
+	readValue(file, snapshot_size);
+	if(!file.good() || std::memcmp(magic, MOVIE_MAGIC, sizeof(magic)) != 0
+		|| version != CHIP8_MOVIE_VERSION || snapshot_size != sizeof(Chip8Snapshot))
+	{
+		return false;
+	}
+
+	uint32_t quirks = 0;
+	uint32_t input_count = 0;
+	uint32_t keyframe_count = 0;
+	readValue(file, quirks);
+	readValue(file, rng_seed);
+	readValue(file, instructions_per_second);
+	readValue(file, keyframe_interval);
+	readValue(file, frame_count);
+	readValue(file, final_instructions);
+	readValue(file, final_display_hash);
+	readValue(file, input_count);
+	readValue(file, keyframe_count);
+	if(!file.good() || keyframe_interval == 0 || quirks > (uint32_t)Chip8Quirks::Modern)
+	{
+		return false;
+	}
+	machine_quirks = (Chip8Quirks)quirks;
+
+	inputs.resize(input_count);
+	keyframes.resize(keyframe_count);
+	for(auto& input : inputs)
+	{
+		readValue(file, input.instruction);
+		readValue(file, input.frame);
+		readValue(file, input.key);
+		readValue(file, input.pressed);
+	}
+	for(auto& keyframe : keyframes)
+	{
+		readValue(file, keyframe.frame);
+		readValue(file, keyframe.first_input);
+		readValue(file, keyframe.state);
+	}
+	if(!file.good())
+	{
+		return false;
+	}
+
+	//seek relies on keyframe n being frame n * keyframe_interval
+	for(size_t i = 0; i < keyframes.size(); i++)
+	{
+		if(keyframes[i].frame != i * keyframe_interval || keyframes[i].first_input > inputs.size())
+		{
+			return false;
+		}
+	}
+	for(auto const& input : inputs)
+	{
+		if(input.key >= NUM_KEYS)
+		{
+			return false;
+		}
+	}
+
+	std::memset(last_keypad, 0, sizeof(last_keypad));
+	play_frame = 0;
+	play_input = 0;
+	return true;
+}
+
+Chip8Quirks Chip8Movie::quirks() const
+{
+	return machine_quirks;
+}
+
+uint64_t Chip8Movie::seed() const
+{
+	return rng_seed;
+}
+
+uint32_t Chip8Movie::frames() const
+{
+	return frame_count;
+}
+
+uint32_t Chip8Movie::currentFrame() const
+{
+	return play_frame;
+}
+
+uint64_t Chip8Movie::finalInstructions() const
+{
+	return final_instructions;
+}
+
+uint64_t Chip8Movie::finalDisplayHash() const
+{
+	return final_display_hash;
+}
+
+//every quirk set createChip8 can build
+template void Chip8Movie::recordFrame(BasicChip8<VipQuirks> const&);
+template void Chip8Movie::undoFrame(BasicChip8<VipQuirks> const&);
+template void Chip8Movie::finish(BasicChip8<VipQuirks> const&);
+template bool Chip8Movie::seek(BasicChip8<VipQuirks>&, uint32_t);
+template bool Chip8Movie::playFrame(BasicChip8<VipQuirks>&);
+
+template void Chip8Movie::recordFrame(BasicChip8<SchipQuirks> const&);
+template void Chip8Movie::undoFrame(BasicChip8<SchipQuirks> const&);
+template void Chip8Movie::finish(BasicChip8<SchipQuirks> const&);
+template bool Chip8Movie::seek(BasicChip8<SchipQuirks>&, uint32_t);
+template bool Chip8Movie::playFrame(BasicChip8<SchipQuirks>&);
+
+template void Chip8Movie::recordFrame(BasicChip8<ModernQuirks> const&);
+template void Chip8Movie::undoFrame(BasicChip8<ModernQuirks> const&);
+template void Chip8Movie::finish(BasicChip8<ModernQuirks> const&);
+template bool Chip8Movie::seek(BasicChip8<ModernQuirks>&, uint32_t);
+template bool Chip8Movie::playFrame(BasicChip8<ModernQuirks>&);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "chip-8.h"
+#include <cstdint>
+#include <vector>
+
+//bumped whenever the movie file layout changes, older movies are rejected
+const uint32_t CHIP8_MOVIE_VERSION = 5;
+
+//A key going down or up, applied before the frame that starts at instruction. Written field by field, the padding never reaches the file
+struct Chip8MovieInput
+{
+	uint64_t instruction;
+	uint32_t frame;
+	uint8_t key;
+	uint8_t pressed;
+};
+
+//Machine state at the start of frame, taken after the frontend applied the frame's keys so its keypad already holds them
+struct Chip8MovieKeyframe
+{
+	uint32_t frame;
+	uint32_t first_input;	//index of the first input recorded after the keyframe
+	Chip8Snapshot state;
+};
+
+//A recorded run of a Chip8: its quirk set, the RNG seed, every keypad transition and a keyframe every keyframe_interval frames.
+//Frames run chip8InstructionsForFrame(instructions_per_second, frame) instructions like the frontend does, so
+//playing the inputs back from any keyframe reproduces the run exactly, and seeking to a frame costs one keyframe load
+//plus at most keyframe_interval frames of emulation
+class Chip8Movie
+{
+public:
+
+	Chip8Movie();
+
+	//starts a new recording, chip8 should be a freshly loaded machine with the given quirks seeded with seed
+	void record(uint64_t seed, uint32_t instructionsPerSecond, Chip8Quirks quirks = Chip8Quirks::Modern,
+		uint32_t keyframeInterval = 10 * TIMER_FREQUENCY);
+	//call right before running each frame, logs the keys that changed since the last frame
+	template<typename Quirks>
+	void recordFrame(BasicChip8<Quirks> const& chip8);
+	//forgets the newest recorded frame, for when the frontend rewinds to the state chip8 is in now
+	template<typename Quirks>
+	void undoFrame(BasicChip8<Quirks> const& chip8);
+	//call once the last frame has run, stores the final display hash replays are checked against
+	template<typename Quirks>
+	void finish(BasicChip8<Quirks> const& chip8);
+
+	//restores chip8 to the start of frame, returns false if the movie doesn't reach it or was recorded with other quirks.
+	//build the machine with createChip8(quirks()) to play any movie
+	template<typename Quirks>
+	bool seek(BasicChip8<Quirks>& chip8, uint32_t frame);
+	//applies the inputs of the current frame and runs it, returns false once the movie has ended
+	template<typename Quirks>
+	bool playFrame(BasicChip8<Quirks>& chip8);
+
+	bool write(char const* filename) const;
+	//returns false if the file can't be read or isn't a movie of this version
+	bool read(char const* filename);
+
+	Chip8Quirks quirks() const;
+	uint64_t seed() const;
+	uint32_t frames() const;
+	//frame playFrame runs next
+	uint32_t currentFrame() const;
+	uint64_t finalInstructions() const;
+	uint64_t finalDisplayHash() const;
+
+private:
+
+	Chip8Quirks machine_quirks;
+	uint64_t rng_seed;
+	uint32_t instructions_per_second;
+	uint32_t keyframe_interval;
+	uint32_t frame_count;
+	uint64_t final_instructions;
+	uint64_t final_display_hash;
+
+	std::vector<Chip8MovieInput> inputs;
+	//keyframes[n] holds frame n * keyframe_interval, which makes it the index
+	std::vector<Chip8MovieKeyframe> keyframes;
+
+	//keys as of the last recorded frame
+	uint8_t last_keypad[NUM_KEYS];
+
+	//playback position
+	uint32_t play_frame;
+	size_t play_input;
+};
@@ -0,0 +1,289 @@
+#include "chip-8.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define CHIP8_RDTSC 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#endif
+
+//Per-opcode microbenchmarks: calls each op_* handler directly, away from fetch, decode and dispatch,
+//and reports the time per call in rdtsc cycles. Fx55/Fx65 run with several X and Dxyn with every height
+//at byte aligned, unaligned and right edge x positions. The SUPER-CHIP instructions run on the schip instantiation,
+//the only one they do anything on, the rest on the default Chip8. The scrolls and 16x16 Dxy0 sprites run in
+//both resolutions, cases marked hi start in hi-res. op_null runs first as the baseline, the net column
+//is what a handler costs on top of the call and the per call reset every handler shares.
+//rdtsc counts at a fixed reference rate, so pin the core clock for numbers that compare across runs.
+//Without rdtsc (not x86) the times are steady_clock nanoseconds instead
+//usage: chip8-opcode-benchmark [-b batches] [-o results.csv] [filter]   (filter keeps cases whose name contains it)
+
+//calls timed back to back, a batch has to be long enough that reading the counter is noise
+const unsigned int CALLS_PER_BATCH = 256;
+
+//register values restored before every call, V1 and V2 are the x and y of most cases
+const uint8_t REGESTER_VALUES[NUM_REGESTERS] =
+{
+	0x00, 0xC7, 0x5A, 0x03, 0x10, 0x21, 0x32, 0x43, 0x54, 0x65, 0x76, 0x87, 0x98, 0xA9, 0xBA, 0x01
+};
+
+//I restored before every call, a 16x16 sprite's worth of varied bytes sits there
+const uint16_t INDEX_VALUE = 0x300;
+
+static inline uint64_t readTicks()
+{
+#ifdef CHIP8_RDTSC
+	//keeps earlier instructions from drifting past the read
+	_mm_lfence();
+	return __rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+class Chip8OpcodeBenchmark
+{
+public:
+
+	using SuperChip8 = BasicChip8<SchipQuirks>;
+
+	template<typename Machine>
+	struct Case
+	{
+		std::string name;
+		uint16_t opcode;
+		void (Machine::*handler)();
+		//value for the x regester, draws use it as the column
+		int vx;
+		//run in hi-res
+		bool hires = false;
+	};
+
+	struct Result
+	{
+		std::string name;
+		uint16_t opcode;
+		double ticks;
+	};
+
+	static std::vector<Case<Chip8>> cases()
+	{
+		std::vector<Case<Chip8>> list =
+		{
+			{"op_null", 0x0000, &Chip8::op_null, -1},
+			{"op_00E0", 0x00E0, &Chip8::op_00E0, -1},
+			{"op_00EE", 0x00EE, &Chip8::op_00EE, -1},
+			{"op_1nnn", 0x1234, &Chip8::op_1nnn, -1},
+			{"op_2nnn", 0x2234, &Chip8::op_2nnn, -1},
+			{"op_3xkk", 0x31C7, &Chip8::op_3xkk, -1},
+			{"op_4xkk", 0x41C7, &Chip8::op_4xkk, -1},
+			{"op_5xy0", 0x5120, &Chip8::op_5xy0, -1},
+			{"op_6xkk", 0x6142, &Chip8::op_6xkk, -1},
+			{"op_7xkk", 0x7142, &Chip8::op_7xkk, -1},
+			{"op_8xy0", 0x8120, &Chip8::op_8xy0, -1},
+			{"op_8xy1", 0x8121, &Chip8::op_8xy1, -1},
+			{"op_8xy2", 0x8122, &Chip8::op_8xy2, -1},
+			{"op_8xy3", 0x8123, &Chip8::op_8xy3, -1},
+			{"op_8xy4", 0x8124, &Chip8::op_8xy4, -1},
+			{"op_8xy5", 0x8125, &Chip8::op_8xy5, -1},
+			{"op_8xy6", 0x8126, &Chip8::op_8xy6, -1},
+			{"op_8xy7", 0x8127, &Chip8::op_8xy7, -1},
+			{"op_8xyE", 0x812E, &Chip8::op_8xyE, -1},
+			{"op_9xy0", 0x9120, &Chip8::op_9xy0, -1},
+			{"op_Annn", 0xA234, &Chip8::op_Annn, -1},
+			{"op_Bnnn", 0xB234, &Chip8::op_Bnnn, -1},
+			{"op_Cxkk", 0xC1FF, &Chip8::op_Cxkk, -1},
+			{"op_Ex9E", 0xE39E, &Chip8::op_Ex9E, -1},
+			{"op_ExA1", 0xE3A1, &Chip8::op_ExA1, -1},
+			{"op_Fx07", 0xF107, &Chip8::op_Fx07, -1},
+			{"op_Fx0A", 0xF10A, &Chip8::op_Fx0A, -1},
+			{"op_Fx15", 0xF115, &Chip8::op_Fx15, -1},
+			{"op_Fx18", 0xF118, &Chip8::op_Fx18, -1},
+			{"op_Fx1E", 0xF11E, &Chip8::op_Fx1E, -1},
+			{"op_Fx29", 0xF329, &Chip8::op_Fx29, -1},
+			{"op_Fx33", 0xF133, &Chip8::op_Fx33, -1}
+		};
+
+		for(unsigned int x : {0x0U, 0x3U, 0x7U, 0xFU})
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "op_Fx55 x=%X", x);
+			list.push_back({name, (uint16_t)(0xF055U | (x << 8U)), &Chip8::op_Fx55, -1});
+			std::snprintf(name, sizeof(name), "op_Fx65 x=%X", x);
+			list.push_back({name, (uint16_t)(0xF065U | (x << 8U)), &Chip8::op_Fx65, -1});
+		}
+
+		//8 is on a byte boundary of the row, 13 straddles two bytes and 60 runs off the right edge
+		for(int column : {8, 13, 60})
+		{
+			for(unsigned int height = 1; height <= 15; height++)
+			{
+				char name[32];
+				std::snprintf(name, sizeof(name), "op_Dxyn n=%u x=%d", height, column);
+				list.push_back({name, (uint16_t)(0xD120U | height), &Chip8::op_Dxyn, column});
+			}
+		}
+
+		return list;
+	}
+
+	static std::vector<Case<SuperChip8>> superChipCases()
+	{
+		std::vector<Case<SuperChip8>> list =
+		{
+			{"op_00Cn", 0x00C4, &SuperChip8::op_00Cn, -1},
+			{"op_00Cn hi", 0x00C4, &SuperChip8::op_00Cn, -1, true},
+			{"op_00FB", 0x00FB, &SuperChip8::op_00FB, -1},
+			{"op_00FB hi", 0x00FB, &SuperChip8::op_00FB, -1, true},
+			{"op_00FC", 0x00FC, &SuperChip8::op_00FC, -1},
+			{"op_00FC hi", 0x00FC, &SuperChip8::op_00FC, -1, true},
+			{"op_00FE", 0x00FE, &SuperChip8::op_00FE, -1},
+			{"op_00FF", 0x00FF, &SuperChip8::op_00FF, -1},
+			{"op_Fx30", 0xF330, &SuperChip8::op_Fx30, -1},
+			{"op_Fx75", 0xF775, &SuperChip8::op_Fx75, -1},
+			{"op_Fx85", 0xF785, &SuperChip8::op_Fx85, -1}
+		};
+
+		//in hi-res 60 runs into the second word of the row
+		for(int column : {8, 13, 60})
+		{
+			char name[32];
+			std::snprintf(name, sizeof(name), "op_Dxy0 x=%d", column);
+			list.push_back({name, 0xD120U, &SuperChip8::op_Dxyn, column});
+			std::snprintf(name, sizeof(name), "op_Dxy0 x=%d hi", column);
+			list.push_back({name, 0xD120U, &SuperChip8::op_Dxyn, column, true});
+		}
+
+		return list;
+	}
+
+	//fastest of batches runs of CALLS_PER_BATCH calls, in cycles per call
+	template<typename Machine>
+	static double time(Case<Machine> const& benchmark, unsigned int batches)
+	{
+		Machine chip8(Chip8Engine::Table);
+		chip8.seed(0xC8);
+		for(unsigned int i = 0; i < 32; i++)
+		{
+			chip8.memory[INDEX_VALUE + i] = 0xA5U ^ (i * 0x3BU);
+		}
+		chip8.hires = benchmark.hires;
+		chip8.keypad[REGESTER_VALUES[3] & 0xFU] = 1;
+
+		uint8_t regesters[NUM_REGESTERS];
+		std::memcpy(regesters, REGESTER_VALUES, sizeof(regesters));
+		if(benchmark.vx >= 0)
+		{
+			regesters[1] = benchmark.vx;
+		}
+
+		chip8.opcodes = benchmark.opcode;
+		chip8.instruction = Machine::decode(benchmark.opcode);
+		void (Machine::*handler)() = benchmark.handler;
+
+		uint64_t best = ~0ULL;
+		for(unsigned int batch = 0; batch < batches; batch++)
+		{
+			uint64_t start = readTicks();
+			for(unsigned int call = 0; call < CALLS_PER_BATCH; call++)
+			{
+				//jumps, calls, skips, adds and loads all change what the next call sees, so every call starts the same
+				std::memcpy(chip8.regesters, regesters, sizeof(regesters));
+				chip8.pc = ROM_START_ADDRESS;
+				chip8.index_regester = INDEX_VALUE;
+				chip8.stack_pointer = 1;
+				(chip8.*handler)();
+			}
+			uint64_t end = readTicks();
+			best = std::min(best, end - start);
+		}
+
+		return (double)best / CALLS_PER_BATCH;
+	}
+};
+
+int main(int argc, char** argv)
+{
+	unsigned int batches = 2000;
+	std::string output_name;
+	std::string filter;
+
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if(arg == "-b" && has_value) batches = std::max(1UL, std::stoul(argv[++i]));
+		else if(arg == "-o" && has_value) output_name = argv[++i];
+		else if(arg[0] == '-')
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			std::cerr << "usage: chip8-opcode-benchmark [-b batches] [-o results.csv] [filter]" << std::endl;
+			return -1;
+		}
+		else
+		{
+			filter = arg;
+		}
+	}
+
+	//op_null comes first
+	std::vector<Chip8OpcodeBenchmark::Case<Chip8>> cases = Chip8OpcodeBenchmark::cases();
+	double baseline = Chip8OpcodeBenchmark::time(cases[0], batches);
+
+#ifdef CHIP8_RDTSC
+	char const* unit = "cycles";
+#else
+	char const* unit = "ns";
+#endif
+
+	std::vector<Chip8OpcodeBenchmark::Result> results;
+	std::printf("%-20s %-6s %10s %10s\n", "handler", "opcode", unit, "net");
+	auto run = [&](auto const& list)
+	{
+		for(auto const& benchmark : list)
+		{
+			//the baseline is always listed
+			bool is_baseline = &benchmark == (void const*)&cases[0];
+			if(!is_baseline && !filter.empty() && benchmark.name.find(filter) == std::string::npos)
+			{
+				continue;
+			}
+
+			double ticks = is_baseline ? baseline : Chip8OpcodeBenchmark::time(benchmark, batches);
+			std::printf("%-20s %04X   %10.2f %10.2f\n", benchmark.name.c_str(), benchmark.opcode, ticks, ticks - baseline);
+			results.push_back({benchmark.name, benchmark.opcode, ticks});
+		}
+	};
+	run(cases);
+	run(Chip8OpcodeBenchmark::superChipCases());
+
+	if(!output_name.empty())
+	{
+		std::ofstream output(output_name);
+		if(!output.is_open())
+		{
+			std::cerr << "could not write " << output_name << std::endl;
+			return -1;
+		}
+
+		output << "handler,opcode," << unit << "_per_call,net_" << unit << "_per_call\n";
+		for(auto const& result : results)
+		{
+			char opcode[5];
+			std::snprintf(opcode, sizeof(opcode), "%04X", result.opcode);
+			output << "\"" << result.name << "\"," << opcode << "," << result.ticks << "," << result.ticks - baseline << "\n";
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,293 @@
+#include "chip-8.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+//Ahead-of-time recompiler: translates a ROM into a C++ translation unit with one function per basic block.
+//usage: chip8-recompile <rom.ch8> <output.cc> [symbol]
+//
+//Link the generated file into a program, declare `extern Chip8StaticProgram const symbol;`
+//and pass &symbol to Chip8::useStaticProgram on a Chip8 built with Chip8Engine::Static.
+//Blocks are found by recursive descent from 0x200. Computed jumps (Bnnn), drawing, input, timers
+//and memory writes are left to the interpreter, as is any block the ROM later overwrites.
+
+//longest run of instructions translated into one block
+const unsigned int MAX_BLOCK_INSTRUCTIONS = 64;
+
+struct Block
+{
+	uint16_t address;
+	uint16_t length;
+	std::string code;
+};
+
+std::string hex(unsigned int value, int digits = 1)
+{
+	char text[16];
+	std::snprintf(text, sizeof(text), "0x%0*X", digits, value);
+	return text;
+}
+
+std::string reg(unsigned int index)
+{
+	return "s.regesters[" + hex(index) + "]";
+}
+
+//straight-line instructions, translated to match the interpreter's op_* handlers exactly.
+//returns false if the instruction has to be left to the interpreter or ends the block
+bool translateStraight(Chip8Instruction const& in, std::ostringstream& code)
+{
+	std::string Vx = reg(in.x);
+	std::string Vy = reg(in.y);
+	std::string VF = reg(0xF);
+
+	switch(in.handler)
+	{
+		case OP_6xkk: code << Vx << " = " << hex(in.kk, 2) << ";"; return true;
+		case OP_7xkk: code << Vx << " += " << hex(in.kk, 2) << ";"; return true;
+		case OP_8xy0: code << Vx << " = " << Vy << ";"; return true;
+		case OP_8xy1: code << Vx << " = " << Vx << " | " << Vy << ";"; return true;
+		case OP_8xy2: code << Vx << " = " << Vx << " & " << Vy << ";"; return true;
+		case OP_8xy3: code << Vx << " = " << Vx << " ^ " << Vy << ";"; return true;
+
+		//like op_8xy4 the carry is written after Vx, so it wins when x is F
+		case OP_8xy4: code << "{ unsigned int sum = " << Vx << " + " << Vy << "; " << Vx << " = sum & 0xFFU; " << VF << " = sum > 0xFFU ? 1 : 0; }"; return true;
+		case OP_8xy5: code << "{ uint8_t difference = " << Vx << " - " << Vy << "; " << VF << " = " << Vx << " > " << Vy << " ? 1 : 0; " << Vx << " = difference; }"; return true;
+		case OP_8xy6: code << VF << " = " << Vx << " & 0x1U; " << Vx << " = " << Vx << " >> 1U;"; return true;
+		case OP_8xy7: code << VF << " = " << Vy << " > " << Vx << " ? 1 : 0; " << Vx << " = " << Vy << " - " << Vx << ";"; return true;
+		case OP_8xyE: code << VF << " = (" << Vx << " & 0x80U) >> 7U; " << Vx << " = " << Vx << " << 1U;"; return true;
+
+		case OP_Annn: code << "s.index_regester = " << hex(in.nnn, 3) << ";"; return true;
+		case OP_Fx1E: code << "s.index_regester = s.index_regester + " << Vx << ";"; return true;
+		case OP_Fx29: code << "s.index_regester = " << hex(FONT_START_ADDRESS, 3) << " + (" << Vx << " * 5);"; return true;
+		//the generator lives in Chip8State, so random numbers don't need the interpreter
+		case OP_Cxkk: code << Vx << " = chip8RandomByte(s.rng_state) & " << hex(in.kk, 2) << ";"; return true;
+		case OP_Fx65: code << "for(unsigned int i = 0; i <= " << hex(in.x) << "; i++) { s.regesters[i] = s.memory[s.index_regester + i]; }"; return true;
+	}
+
+	return false;
+}
+
+//jumps, calls, returns and skips end a block and are translated into it.
+//returns false if the instruction is not one of them
+bool translateTerminator(Chip8Instruction const& in, uint16_t next, std::ostringstream& code, std::vector<uint16_t>& successors)
+{
+	std::string skip_to = hex(next + 2, 3) + " : " + hex(next, 3) + ";";
+
+	switch(in.handler)
+	{
+		case OP_1nnn:
+			code << "s.pc = " << hex(in.nnn, 3) << ";";
+			successors.push_back(in.nnn);
+			return true;
+
+		case OP_2nnn:
+			code << "s.stack[s.stack_pointer] = " << hex(next, 3) << "; ++s.stack_pointer; s.pc = " << hex(in.nnn, 3) << ";";
+			successors.push_back(in.nnn);
+			successors.push_back(next);
+			return true;
+
+		case OP_00EE:
+			code << "--s.stack_pointer; s.pc = s.stack[s.stack_pointer];";
+			return true;
+
+		case OP_3xkk: code << "s.pc = " << reg(in.x) << " == " << hex(in.kk, 2) << " ? " << skip_to; break;
+		case OP_4xkk: code << "s.pc = " << reg(in.x) << " != " << hex(in.kk, 2) << " ? " << skip_to; break;
+		case OP_5xy0: code << "s.pc = " << reg(in.x) << " == " << reg(in.y) << " ? " << skip_to; break;
+		case OP_9xy0: code << "s.pc = " << reg(in.x) << " != " << reg(in.y) << " ? " << skip_to; break;
+
+		default:
+			return false;
+	}
+
+	successors.push_back(next);
+	successors.push_back(next + 2);
+	return true;
+}
+
+//where execution may continue after an instruction that is left to the interpreter
+void interpretedSuccessors(Chip8Instruction const& in, uint16_t next, std::vector<uint16_t>& successors)
+{
+	switch(in.handler)
+	{
+		//computed jump, the target is unknown until run time
+		case OP_Bnnn:
+			break;
+
+		case OP_Ex9E:
+		case OP_ExA1:
+			successors.push_back(next);
+			successors.push_back(next + 2);
+			break;
+
+		default:
+			successors.push_back(next);
+			break;
+	}
+}
+
+//translates the block starting at address, or returns false if its first instruction is left to the interpreter
+bool translateBlock(std::vector<uint8_t> const& rom, uint16_t address, Block& block, std::vector<uint16_t>& successors)
+{
+	std::ostringstream code;
+	unsigned int count = 0;
+	uint16_t pc = address;
+	uint16_t rom_end = ROM_START_ADDRESS + rom.size();
+	bool terminated = false;
+
+	while(count < MAX_BLOCK_INSTRUCTIONS && pc + 1U < rom_end)
+	{
+		uint16_t opcode = (rom[pc - ROM_START_ADDRESS] << 8U) | rom[pc + 1 - ROM_START_ADDRESS];
+		Chip8Instruction in = Chip8::decode(opcode);
+		std::ostringstream line;
+
+		if(translateStraight(in, line))
+		{
+			code << "\t\t" << line.str() << " //" << hex(pc, 3) << ": " << hex(opcode, 4) << "\n";
+			count++;
+			pc += 2;
+			continue;
+		}
+
+		if(translateTerminator(in, pc + 2, line, successors))
+		{
+			code << "\t\t" << line.str() << " //" << hex(pc, 3) << ": " << hex(opcode, 4) << "\n";
+			count++;
+			pc += 2;
+			terminated = true;
+			break;
+		}
+
+		//the interpreter runs this one, then carries on where it leads
+		interpretedSuccessors(in, pc + 2, successors);
+		break;
+	}
+
+	if(!terminated)
+	{
+		//stopped before an interpreted instruction, the end of the ROM or the block size limit
+		code << "\t\ts.pc = " << hex(pc, 3) << ";\n";
+		if(count == MAX_BLOCK_INSTRUCTIONS)
+		{
+			successors.push_back(pc);
+		}
+	}
+
+	if(count == 0)
+	{
+		return false;
+	}
+
+	block.address = address;
+	block.length = pc - address;
+	block.code = code.str() + "\t\treturn " + std::to_string(count) + ";\n";
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc != 3 && argc != 4)
+	{
+		std::cerr << "usage: chip8-recompile <rom.ch8> <output.cc> [symbol]" << std::endl;
+		return -1;
+	}
+
+	char const* rom_name = argv[1];
+	char const* output_name = argv[2];
+	std::string symbol = argc == 4 ? argv[3] : "chip8_static_program";
+
+	std::ifstream rom_file(rom_name, std::ios_base::binary);
+	if(!rom_file.is_open())
+	{
+		std::cerr << "could not open " << rom_name << std::endl;
+		return -1;
+	}
+	std::vector<uint8_t> rom((std::istreambuf_iterator<char>(rom_file)), std::istreambuf_iterator<char>());
+
+	if(rom.size() > MEMORY_SIZE - ROM_START_ADDRESS)
+	{
+		std::cerr << rom_name << " does not fit in memory" << std::endl;
+		return -1;
+	}
+
+	//recursive descent from the entry point, odd addresses are left to the interpreter
+	std::map<uint16_t, Block> blocks;
+	std::set<uint16_t> visited;
+	std::vector<uint16_t> pending = {ROM_START_ADDRESS};
+
+	while(!pending.empty())
+	{
+		uint16_t address = pending.back();
+		pending.pop_back();
+
+		if(visited.count(address) || (address & 0x1U) || address < ROM_START_ADDRESS || address >= ROM_START_ADDRESS + rom.size())
+		{
+			continue;
+		}
+		visited.insert(address);
+
+		Block block;
+		std::vector<uint16_t> successors;
+		if(translateBlock(rom, address, block, successors))
+		{
+			blocks[address] = block;
+		}
+		pending.insert(pending.end(), successors.begin(), successors.end());
+	}
+
+	std::ofstream output(output_name);
+	if(!output.is_open())
+	{
+		std::cerr << "could not write " << output_name << std::endl;
+		return -1;
+	}
+
+	output << "//Generated by chip8-recompile from " << rom_name << ", regenerate instead of editing\n";
+	output << "#include \"chip-8.h\"\n\n";
+	output << "namespace\n{\n";
+
+	output << "\tuint8_t const rom[] =\n\t{";
+	for(size_t i = 0; i < rom.size(); i++)
+	{
+		output << (i % 16 == 0 ? "\n\t\t" : " ") << hex(rom[i], 2) << ",";
+	}
+	output << "\n\t};\n\n";
+
+	for(auto const& entry : blocks)
+	{
+		output << "\tunsigned int block_" << hex(entry.first, 3) << "(Chip8State& s)\n\t{\n";
+		output << entry.second.code;
+		output << "\t}\n\n";
+	}
+
+	if(!blocks.empty())
+	{
+		output << "\tChip8StaticBlockEntry const blocks[] =\n\t{\n";
+		for(auto const& entry : blocks)
+		{
+			output << "\t\t{" << hex(entry.first, 3) << ", " << entry.second.length << ", block_" << hex(entry.first, 3) << "},\n";
+		}
+		output << "\t};\n";
+	}
+	output << "}\n\n";
+
+	output << "extern Chip8StaticProgram const " << symbol << ";\n";
+	output << "Chip8StaticProgram const " << symbol << " = {rom, sizeof(rom), ";
+	if(blocks.empty())
+	{
+		output << "nullptr, 0};\n";
+	}
+	else
+	{
+		output << "blocks, sizeof(blocks) / sizeof(blocks[0])};\n";
+	}
+
+	std::cout << rom_name << ": " << blocks.size() << " blocks written to " << output_name << std::endl;
+	return 0;
+}
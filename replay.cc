@@ -0,0 +1,84 @@
+#include "chip-8.h"
+#include "movie.h"
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <variant>
+
+//Plays a movie recorded by the frontend headless at full speed and checks it ends on the recorded screen.
+//usage: chip8-replay [-e engine] [-f start frame] <movie>
+//
+//The ROM isn't needed, the first keyframe already holds it, and the machine is built with the quirk set the movie
+//was recorded with. Starting from a later frame seeks through the
+//keyframe index first. Exits with 0 if the final display hash and instruction count match the recording
+
+int main(int argc, char** argv)
+{
+	Chip8Engine engine = Chip8Engine::Cached;
+	uint32_t start_frame = 0;
+	char const* movie_name = nullptr;
+
+	for(int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if(arg == "-e" && has_value)
+		{
+			if(!parseChip8Engine(argv[++i], engine))
+			{
+				std::cerr << "unknown engine " << argv[i] << std::endl;
+				return -1;
+			}
+		}
+		else if(arg == "-f" && has_value) start_frame = std::stoul(argv[++i]);
+		else if(arg[0] == '-')
+		{
+			std::cerr << "unknown option " << arg << std::endl;
+			return -1;
+		}
+		else movie_name = argv[i];
+	}
+
+	if(!movie_name)
+	{
+		std::cerr << "usage: chip8-replay [-e engine] [-f start frame] <movie>" << std::endl;
+		return -1;
+	}
+
+	Chip8Movie movie;
+	if(!movie.read(movie_name))
+	{
+		std::cerr << "could not read " << movie_name << std::endl;
+		return -1;
+	}
+
+	std::unique_ptr<Chip8Variant> machine = createChip8(movie.quirks(), engine);
+	return std::visit([&](auto& Chip8_Emulator)
+	{
+		auto start = std::chrono::steady_clock::now();
+		if(!movie.seek(Chip8_Emulator, start_frame))
+		{
+			std::cerr << "movie has only " << movie.frames() << " frames" << std::endl;
+			return -1;
+		}
+		uint64_t first_instruction = Chip8_Emulator.instructions();
+
+		while(movie.playFrame(Chip8_Emulator))
+		{
+		}
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+		char hash[17];
+		std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)Chip8_Emulator.displayHash());
+		bool matched = Chip8_Emulator.displayHash() == movie.finalDisplayHash()
+			&& Chip8_Emulator.instructions() == movie.finalInstructions();
+
+		std::cout << movie.frames() << " frames (" << chip8QuirksName(movie.quirks()) << ", seed " << movie.seed() << ") replayed from frame " << start_frame
+			<< " in " << seconds << " s, " << ((Chip8_Emulator.instructions() - first_instruction) / seconds) / 1000000.0
+			<< " M instructions/s, display hash " << hash << (matched ? " matches" : " DOES NOT MATCH") << std::endl;
+		return matched ? 0 : 1;
+	}, *machine);
+}
@@ -0,0 +1,309 @@
+#include "rewind.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+//run lengths are stored in 16 bits
+static_assert(sizeof(Chip8Snapshot) <= 0xFFFF, "snapshot too large for 16 bit run lengths");
+
+//a literal run only ends at this many unchanged bytes, shorter gaps cost less to copy than to start a new run
+const size_t MIN_ZERO_RUN = 4;
+
+//snapshots are diffed and rebuilt as raw bytes, which is only sound for trivially copyable types
+static_assert(std::is_trivially_copyable_v<Chip8Snapshot>, "snapshot must be trivially copyable to diff its bytes");
+
+static inline uint8_t* snapshotBytes(Chip8Snapshot& snapshot)
+{
+	return reinterpret_cast<uint8_t*>(&snapshot);
+}
+
+static inline uint8_t const* snapshotBytes(Chip8Snapshot const& snapshot)
+{
+	return reinterpret_cast<uint8_t const*>(&snapshot);
+}
+
+//clears padding as well, so deltas against a cleared snapshot are deterministic
+static inline void clearSnapshot(Chip8Snapshot& snapshot)
+{
+	std::fill_n(snapshotBytes(snapshot), sizeof(Chip8Snapshot), 0);
+}
+
+static inline void writeLength(std::vector<uint8_t>& out, size_t length)
+{
+	out.push_back(length & 0xFFU);
+	out.push_back(length >> 8U);
+}
+
+static inline size_t readLength(uint8_t const* in)
+{
+	return in[0] | (in[1] << 8U);
+}
+
+Chip8Rewind::Chip8Rewind(unsigned int maxFrames, size_t bufferBytes, unsigned int keyframeInterval)
+	:buffer(new uint8_t[bufferBytes]), buffer_size(bufferBytes), write_offset(0),
+	entries(maxFrames > 0 ? maxFrames : 1), first_entry(0), entry_count(0),
+	keyframe_interval(keyframeInterval > 0 ? keyframeInterval : 1), keyframe_loaded(0), keyframe_valid(false)
+{
+	clearSnapshot(zero_state);
+	//worst case is one literal run covering the whole snapshot
+	encoded.reserve(sizeof(Chip8Snapshot) + 4);
+}
+
+template<typename Quirks>
+void Chip8Rewind::push(BasicChip8<Quirks> const& chip8)
+{
+	chip8.saveState(scratch);
+
+	uint64_t frame = entry_count > 0 ? entry(entry_count - 1).frame + 1 : 0;
+	bool keyframe = entry_count == 0 || frame - entry(entry_count - 1).keyframe >= keyframe_interval;
+
+	if(entry_count == entries.size())
+	{
+		dropOldestKeyframe();
+		keyframe = keyframe || entry_count == 0;
+	}
+
+	if(!keyframe)
+	{
+		loadKeyframe(entry(entry_count - 1).keyframe);
+		encode(scratch, keyframe_state, encoded);
+	}
+	else
+	{
+		encode(scratch, zero_state, encoded);
+	}
+
+	size_t offset;
+	if(!allocate(encoded.size(), offset))
+	{
+		return;
+	}
+	if(!keyframe && entry_count == 0)
+	{
+		//making room dropped the keyframe this delta is against, store the frame as a keyframe instead
+		keyframe = true;
+		encode(scratch, zero_state, encoded);
+		if(!allocate(encoded.size(), offset))
+		{
+			return;
+		}
+	}
+
+	std::memcpy(buffer.get() + offset, encoded.data(), encoded.size());
+	write_offset = offset + encoded.size();
+
+	Entry& added = entry(entry_count);
+	entry_count++;
+	added.offset = offset;
+	added.size = encoded.size();
+	added.frame = frame;
+	added.keyframe = keyframe ? frame : entry(entry_count - 2).keyframe;
+
+	if(keyframe)
+	{
+		keyframe_state = scratch;
+		keyframe_loaded = frame;
+		keyframe_valid = true;
+	}
+}
+
+template<typename Quirks>
+bool Chip8Rewind::stepBack(BasicChip8<Quirks>& chip8)
+{
+	if(entry_count < 2)
+	{
+		return false;
+	}
+
+	//the newest entry was the last one written, so its space is simply handed back
+	Entry dropped = entry(entry_count - 1);
+	entry_count--;
+	write_offset = dropped.offset;
+	if(dropped.frame == dropped.keyframe && keyframe_loaded == dropped.frame)
+	{
+		keyframe_valid = false;
+	}
+
+	Entry const& restored = entry(entry_count - 1);
+	loadKeyframe(restored.keyframe);
+	scratch = keyframe_state;
+	if(restored.frame != restored.keyframe)
+	{
+		apply(buffer.get() + restored.offset, restored.size, scratch);
+	}
+
+	chip8.loadState(scratch);
+	return true;
+}
+
+void Chip8Rewind::clear()
+{
+	first_entry = 0;
+	entry_count = 0;
+	write_offset = 0;
+	keyframe_valid = false;
+}
+
+unsigned int Chip8Rewind::frames() const
+{
+	return entry_count;
+}
+
+size_t Chip8Rewind::bytesUsed() const
+{
+	size_t used = 0;
+	for(unsigned int i = 0; i < entry_count; i++)
+	{
+		used += entries[(first_entry + i) % entries.size()].size;
+	}
+	return used;
+}
+
+Chip8Rewind::Entry& Chip8Rewind::entry(unsigned int index)
+{
+	return entries[(first_entry + index) % entries.size()];
+}
+
+void Chip8Rewind::encode(Chip8Snapshot const& snapshot, Chip8Snapshot const& base, std::vector<uint8_t>& encoded)
+{
+	uint8_t const* current = snapshotBytes(snapshot);
+	uint8_t const* previous = snapshotBytes(base);
+	size_t size = sizeof(Chip8Snapshot);
+
+	//pairs of (unchanged bytes to skip, changed bytes that follow) then the changed bytes XORed with base
+	encoded.clear();
+	size_t i = 0;
+	while(i < size)
+	{
+		size_t zero_start = i;
+		while(i < size && current[i] == previous[i])
+		{
+			i++;
+		}
+
+		size_t literal_start = i;
+		while(i < size)
+		{
+			if(current[i] != previous[i])
+			{
+				i++;
+				continue;
+			}
+
+			size_t gap = i;
+			while(gap < size && gap - i < MIN_ZERO_RUN && current[gap] == previous[gap])
+			{
+				gap++;
+			}
+			if(gap - i >= MIN_ZERO_RUN || gap == size)
+			{
+				break;
+			}
+			i = gap;
+		}
+
+		writeLength(encoded, literal_start - zero_start);
+		writeLength(encoded, i - literal_start);
+		for(size_t j = literal_start; j < i; j++)
+		{
+			encoded.push_back(current[j] ^ previous[j]);
+		}
+	}
+}
+
+void Chip8Rewind::apply(uint8_t const* encoded, size_t size, Chip8Snapshot& snapshot)
+{
+	uint8_t* out = snapshotBytes(snapshot);
+	uint8_t const* end = encoded + size;
+	size_t position = 0;
+
+	while(encoded < end)
+	{
+		position += readLength(encoded);
+		size_t literals = readLength(encoded + 2);
+		encoded += 4;
+
+		for(size_t j = 0; j < literals; j++)
+		{
+			out[position + j] ^= encoded[j];
+		}
+		position += literals;
+		encoded += literals;
+	}
+}
+
+bool Chip8Rewind::allocate(size_t size, size_t& offset)
+{
+	if(size > buffer_size)
+	{
+		return false;
+	}
+
+	while(true)
+	{
+		if(entry_count == 0)
+		{
+			offset = 0;
+			return true;
+		}
+
+		//the used space runs from the oldest entry up to write_offset, wrapping past the end of the ring
+		size_t tail = entry(0).offset;
+		if(write_offset > tail)
+		{
+			if(buffer_size - write_offset >= size)
+			{
+				offset = write_offset;
+				return true;
+			}
+			if(tail >= size)
+			{
+				offset = 0;
+				return true;
+			}
+		}
+		else if(tail - write_offset >= size)
+		{
+			offset = write_offset;
+			return true;
+		}
+
+		dropOldestKeyframe();
+	}
+}
+
+void Chip8Rewind::dropOldestKeyframe()
+{
+	//the deltas after a keyframe are useless without it so they go too
+	do
+	{
+		first_entry = (first_entry + 1) % entries.size();
+		entry_count--;
+	}
+	while(entry_count > 0 && entry(0).frame != entry(0).keyframe);
+}
+
+void Chip8Rewind::loadKeyframe(uint64_t keyframe)
+{
+	if(keyframe_valid && keyframe_loaded == keyframe)
+	{
+		return;
+	}
+
+	//frames in the ring are numbered consecutively, so the keyframe's index follows from its number
+	Entry const& stored = entry(keyframe - entry(0).frame);
+	clearSnapshot(keyframe_state);
+	apply(buffer.get() + stored.offset, stored.size, keyframe_state);
+	keyframe_loaded = keyframe;
+	keyframe_valid = true;
+}
+
+//every quirk set createChip8 can build
+template void Chip8Rewind::push(BasicChip8<VipQuirks> const&);
+template bool Chip8Rewind::stepBack(BasicChip8<VipQuirks>&);
+
+template void Chip8Rewind::push(BasicChip8<SchipQuirks> const&);
+template bool Chip8Rewind::stepBack(BasicChip8<SchipQuirks>&);
+
+template void Chip8Rewind::push(BasicChip8<ModernQuirks> const&);
+template bool Chip8Rewind::stepBack(BasicChip8<ModernQuirks>&);
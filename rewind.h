@@ -0,0 +1,83 @@
+#pragma once
+
+#include "chip-8.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+//Keeps the last frames of a Chip8 so it can be stepped backwards.
+//Every keyframe_interval frames a full keyframe is stored, the frames in between are stored as the XOR
+//of their snapshot with the keyframe, run length encoded so the bytes that didn't change cost next to nothing.
+//Restoring any frame is one keyframe decode, cached while stepping through its frames, plus one delta.
+//Everything lives in a byte ring allocated up front, the oldest keyframe and its deltas are dropped
+//together when either the ring or the frame limit runs out
+class Chip8Rewind
+{
+public:
+
+	Chip8Rewind(unsigned int maxFrames = 60 * TIMER_FREQUENCY, size_t bufferBytes = 4 << 20, unsigned int keyframeInterval = TIMER_FREQUENCY);
+
+	//records the machine as the newest frame, call once per frame.
+	//snapshots don't carry the quirk set, so a history only ever holds frames of one machine
+	template<typename Quirks>
+	void push(BasicChip8<Quirks> const& chip8);
+
+	//drops the newest frame and restores the one before it into chip8.
+	//returns false, leaving chip8 alone, when there is no earlier frame
+	template<typename Quirks>
+	bool stepBack(BasicChip8<Quirks>& chip8);
+
+	//forgets every frame
+	void clear();
+
+	//frames currently held
+	unsigned int frames() const;
+	//bytes of the ring used by those frames
+	size_t bytesUsed() const;
+
+private:
+
+	struct Entry
+	{
+		size_t offset;	//where the encoded snapshot starts in the ring
+		size_t size;
+		uint64_t frame;
+		uint64_t keyframe;	//frame number of the keyframe the delta is against, its own number for a keyframe
+	};
+
+	Entry& entry(unsigned int index);
+
+	//XORs base into snapshot and run length encodes the result into encoded
+	static void encode(Chip8Snapshot const& snapshot, Chip8Snapshot const& base, std::vector<uint8_t>& encoded);
+	//XORs encoded data produced by encode into snapshot
+	static void apply(uint8_t const* encoded, size_t size, Chip8Snapshot& snapshot);
+
+	//finds room for size bytes, dropping the oldest keyframes until it fits. returns false if it never will
+	bool allocate(size_t size, size_t& offset);
+	void dropOldestKeyframe();
+
+	//makes keyframe_state hold the keyframe with the given frame number
+	void loadKeyframe(uint64_t keyframe);
+
+	std::unique_ptr<uint8_t[]> buffer;
+	size_t buffer_size;
+	size_t write_offset;
+
+	//ring of frame entries, oldest first
+	std::vector<Entry> entries;
+	unsigned int first_entry;
+	unsigned int entry_count;
+
+	unsigned int keyframe_interval;
+
+	//decoded copy of the keyframe the newest frames are stored against
+	Chip8Snapshot keyframe_state;
+	uint64_t keyframe_loaded;
+	bool keyframe_valid;
+
+	//scratch space so push and stepBack don't allocate
+	Chip8Snapshot scratch;
+	Chip8Snapshot zero_state;
+	std::vector<uint8_t> encoded;
+};
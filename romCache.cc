@@ -0,0 +1,105 @@
+#include "romCache.h"
+#include <fstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define CHIP8_ROM_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+Chip8RomCache::Chip8RomCache()
+{
+}
+
+Chip8RomCache::~Chip8RomCache()
+{
+	for(auto& file : files)
+	{
+		Mapping& mapping = file.second;
+#ifdef CHIP8_ROM_MMAP
+		if(mapping.mapped)
+		{
+			munmap(const_cast<uint8_t*>(mapping.data), mapping.size);
+			continue;
+		}
+#endif
+		delete[] mapping.data;
+	}
+}
+
+Chip8RomCache& Chip8RomCache::shared()
+{
+	static Chip8RomCache cache;
+	return cache;
+}
+
+bool Chip8RomCache::get(char const* filename, std::span<const uint8_t>& rom)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto found = files.find(filename);
+	if(found != files.end())
+	{
+		rom = std::span<const uint8_t>(found->second.data, found->second.size);
+		return true;
+	}
+
+	Mapping mapping = {nullptr, 0, false};
+
+#ifdef CHIP8_ROM_MMAP
+	int descriptor = open(filename, O_RDONLY);
+	if(descriptor < 0)
+	{
+		return false;
+	}
+
+	struct stat status;
+	if(fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode))
+	{
+		close(descriptor);
+		return false;
+	}
+
+	//an empty file can't be mapped but is still a (useless) ROM
+	if(status.st_size > 0)
+	{
+		void* address = mmap(nullptr, status.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+		if(address == MAP_FAILED)
+		{
+			close(descriptor);
+			return false;
+		}
+		mapping = {static_cast<uint8_t const*>(address), (size_t)status.st_size, true};
+	}
+	close(descriptor);
+#else
+	std::ifstream rom_file(filename, std::ios_base::binary);
+	if(!rom_file.is_open())
+	{
+		return false;
+	}
+
+	rom_file.seekg(0, rom_file.end);
+	std::streamoff length = rom_file.tellg();
+	rom_file.seekg(0, rom_file.beg);
+	if(length < 0)
+	{
+		return false;
+	}
+
+	uint8_t* buffer = new uint8_t[length];
+	rom_file.read(reinterpret_cast<char*>(buffer), length);
+	if(!rom_file)
+	{
+		delete[] buffer;
+		return false;
+	}
+	mapping = {buffer, (size_t)length, false};
+#endif
+
+	files[filename] = mapping;
+	rom = std::span<const uint8_t>(mapping.data, mapping.size);
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+//Maps ROM files into memory once and hands out read-only views of them, so machines loading the same ROM
+//over and over share one copy and never touch the file again. ROM files are assumed not to change while
+//the process runs. Safe to use from several threads
+class Chip8RomCache
+{
+public:
+
+	Chip8RomCache();
+	~Chip8RomCache();
+
+	Chip8RomCache(Chip8RomCache const&) = delete;
+	Chip8RomCache& operator=(Chip8RomCache const&) = delete;
+
+	//the cache Chip8::loadROM(char const*) uses
+	static Chip8RomCache& shared();
+
+	//sets rom to the contents of the file, mapping it on first use. returns false if it can't be read.
+	//the view stays valid as long as the cache
+	bool get(char const* filename, std::span<const uint8_t>& rom);
+
+private:
+
+	struct Mapping
+	{
+		uint8_t const* data;
+		size_t size;
+		bool mapped;	//false when the file was read into a heap buffer instead
+	};
+
+	std::mutex lock;
+	std::unordered_map<std::string, Mapping> files;
+};
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "chip-8.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+//Helpers shared by the ctest programs. Each test takes the ROMS directory as its first argument,
+//prints what went wrong to std::cerr and exits with 1 on failure
+
+//every regular file in dir, sorted so failures are reported in the same order on every run
+inline std::vector<std::string> testRoms(char const* dir)
+{
+	std::vector<std::string> roms;
+	for(auto const& entry : std::filesystem::directory_iterator(dir))
+	{
+		if(entry.is_regular_file() && entry.path().filename().string()[0] != '.')
+		{
+			roms.push_back(entry.path().string());
+		}
+	}
+	std::sort(roms.begin(), roms.end());
+	return roms;
+}
+
+//the benchmark's scripted input: walks the keypad holding each key for a few frames then releasing it
+inline void testScriptedInput(uint8_t* keypad, uint64_t frame)
+{
+	uint64_t step = frame / 6;
+	std::memset(keypad, 0, NUM_KEYS);
+	if(step % 2 == 0)
+	{
+		keypad[(step / 2) % NUM_KEYS] = 1;
+	}
+}
+
+//compares field by field, padding bytes are allowed to differ
+inline bool sameSnapshot(Chip8Snapshot const& a, Chip8Snapshot const& b)
+{
+	Chip8State const& x = a.machine;
+	Chip8State const& y = b.machine;
+	return a.instruction_count == b.instruction_count
+		&& std::memcmp(x.memory, y.memory, sizeof(x.memory)) == 0
+		&& std::memcmp(x.regesters, y.regesters, sizeof(x.regesters)) == 0
+		&& x.pc == y.pc && x.index_regester == y.index_regester
+		&& std::memcmp(x.stack, y.stack, sizeof(x.stack)) == 0 && x.stack_pointer == y.stack_pointer
+		&& x.sound_timer == y.sound_timer && x.delay_timer == y.delay_timer
+		&& x.sound_timer_start == y.sound_timer_start && x.delay_timer_start == y.delay_timer_start
+		&& x.timer_ticks == y.timer_ticks
+		&& std::memcmp(x.keypad, y.keypad, sizeof(x.keypad)) == 0
+		&& std::memcmp(x.display, y.display, sizeof(x.display)) == 0
+		&& x.hires == y.hires
+		&& std::memcmp(x.flag_regesters, y.flag_regesters, sizeof(x.flag_regesters)) == 0
+		&& x.rng_state == y.rng_state;
+}
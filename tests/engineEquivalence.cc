@@ -0,0 +1,127 @@
+#include "chip8Test.h"
+#include <iostream>
+#include <memory>
+#include <variant>
+
+//Runs every bundled ROM on the table, switch, cached and jit engines side by side under each quirk set
+//and checks their snapshots agree after every frame.
+//Built with CHIP8_TEST_STATIC the static engine runs too, and the ROM chip8_static_program was recompiled from
+//is the second argument. The program is installed on its ROM with the modern quirks, the only set it supports,
+//and everywhere else the static engine falls back to interpreting
+
+#ifdef CHIP8_TEST_STATIC
+extern Chip8StaticProgram const chip8_static_program;
+#endif
+
+const uint64_t TEST_SEED = 0xC8;
+const unsigned int TEST_FRAMES = 600;
+const unsigned int TEST_INSTRUCTIONS_PER_FRAME = 50;
+
+int main(int argc, char** argv)
+{
+#ifdef CHIP8_TEST_STATIC
+	if(argc < 3)
+	{
+		std::cerr << "usage: chip8-test-engines <rom directory> <static rom>" << std::endl;
+		return -1;
+	}
+#else
+	if(argc < 2)
+	{
+		std::cerr << "usage: chip8-test-engines <rom directory>" << std::endl;
+		return -1;
+	}
+#endif
+
+	std::vector<std::string> roms = testRoms(argv[1]);
+#ifdef CHIP8_TEST_STATIC
+	std::string static_rom = argv[2];
+	if(std::none_of(roms.begin(), roms.end(), [&](std::string const& rom) { return std::filesystem::equivalent(rom, static_rom); }))
+	{
+		roms.push_back(static_rom);
+	}
+	unsigned int static_installs = 0;
+#endif
+
+	unsigned int failures = 0;
+	for(auto const& rom : roms)
+	{
+		for(Chip8Quirks quirks : {Chip8Quirks::Vip, Chip8Quirks::Schip, Chip8Quirks::Modern})
+		{
+			std::vector<Chip8Engine> engines;
+			std::vector<std::unique_ptr<Chip8Variant>> machines;
+			for(Chip8Engine engine : CHIP8_ENGINES)
+			{
+#ifndef CHIP8_TEST_STATIC
+				//static needs blocks recompiled from this exact ROM
+				if(engine == Chip8Engine::Static)
+				{
+					continue;
+				}
+#endif
+				engines.push_back(engine);
+				machines.push_back(createChip8(quirks, engine));
+			}
+
+			bool loaded = true;
+			for(size_t i = 0; i < machines.size(); i++)
+			{
+				std::visit([&](auto& chip8)
+				{
+					chip8.seed(TEST_SEED);
+					loaded = chip8.loadROM(rom.c_str()) && loaded;
+#ifdef CHIP8_TEST_STATIC
+					if(loaded && engines[i] == Chip8Engine::Static && chip8.useStaticProgram(&chip8_static_program))
+					{
+						static_installs++;
+					}
+#endif
+				}, *machines[i]);
+			}
+			if(!loaded)
+			{
+				std::cerr << rom << ": could not load" << std::endl;
+				failures++;
+				break;
+			}
+
+			Chip8Snapshot reference;
+			Chip8Snapshot snapshot;
+			for(unsigned int frame = 0; frame < TEST_FRAMES; frame++)
+			{
+				bool diverged = false;
+				for(size_t i = 0; i < machines.size(); i++)
+				{
+					std::visit([&](auto& chip8)
+					{
+						testScriptedInput(chip8.keypad, frame);
+						chip8.runFrame(TEST_INSTRUCTIONS_PER_FRAME);
+						chip8.saveState(i == 0 ? reference : snapshot);
+					}, *machines[i]);
+
+					if(i > 0 && !sameSnapshot(reference, snapshot))
+					{
+						std::cerr << rom << " (" << chip8QuirksName(quirks) << "): " << chip8EngineName(engines[i])
+							<< " differs from " << chip8EngineName(engines[0]) << " after frame " << frame << std::endl;
+						diverged = true;
+					}
+				}
+				if(diverged)
+				{
+					failures++;
+					break;
+				}
+			}
+		}
+	}
+
+#ifdef CHIP8_TEST_STATIC
+	if(static_installs == 0)
+	{
+		std::cerr << static_rom << ": the static program was never installed, so no recompiled block ran" << std::endl;
+		failures++;
+	}
+#endif
+
+	return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,166 @@
+#include "arena.h"
+#include "chip8Test.h"
+#include "instancePool.h"
+#include <iostream>
+#include <vector>
+
+//Checks the instance pool and the arena hand out machines that behave like one built on its own:
+//pooled machines start every episode from the boot image, arena machines run the ROM like a heap machine,
+//and both keep count correctly as machines come and go
+
+const uint64_t TEST_SEED = 11;
+const unsigned int TEST_FRAMES = 200;
+const unsigned int TEST_INSTRUCTIONS_PER_FRAME = 40;
+const unsigned int TEST_POOL_CAPACITY = 4;
+const unsigned int TEST_ARENA_MACHINES = 150;
+
+static void runEpisode(Chip8& chip8)
+{
+	chip8.seed(TEST_SEED);
+	for(unsigned int frame = 0; frame < TEST_FRAMES; frame++)
+	{
+		testScriptedInput(chip8.keypad, frame);
+		chip8.runFrame(TEST_INSTRUCTIONS_PER_FRAME);
+	}
+}
+
+static unsigned int testPool(std::string const& rom, Chip8Snapshot const& expected)
+{
+	unsigned int failures = 0;
+	Chip8InstancePool pool(TEST_POOL_CAPACITY);
+	if(!pool.loadROM(rom.c_str()))
+	{
+		std::cerr << rom << ": pool could not load" << std::endl;
+		return 1;
+	}
+
+	//two episodes on every machine, the second has to start from the boot image, not where the first ended
+	for(unsigned int episode = 0; episode < 2; episode++)
+	{
+		std::vector<Chip8*> acquired;
+		while(Chip8* chip8 = pool.acquire())
+		{
+			acquired.push_back(chip8);
+		}
+		if(acquired.size() != TEST_POOL_CAPACITY || pool.available() != 0)
+		{
+			std::cerr << rom << ": pool handed out " << acquired.size() << " of " << TEST_POOL_CAPACITY << " machines" << std::endl;
+			failures++;
+		}
+
+		Chip8Snapshot actual;
+		for(Chip8* chip8 : acquired)
+		{
+			runEpisode(*chip8);
+			chip8->saveState(actual);
+			if(!sameSnapshot(expected, actual))
+			{
+				std::cerr << rom << ": pooled machine ended episode " << episode << " differently" << std::endl;
+				failures++;
+			}
+			if(!pool.release(chip8))
+			{
+				std::cerr << rom << ": pool refused its own machine" << std::endl;
+				failures++;
+			}
+		}
+	}
+
+	//misuse asserts in debug builds, release builds report it instead
+#ifdef NDEBUG
+	Chip8 stranger;
+	Chip8* chip8 = pool.acquire();
+	if(!pool.release(chip8) || pool.release(chip8) || pool.release(&stranger) || pool.available() != pool.capacity())
+	{
+		std::cerr << rom << ": pool accepted a double release or a foreign machine" << std::endl;
+		failures++;
+	}
+#endif
+	return failures;
+}
+
+static unsigned int testArena(std::string const& rom, Chip8Snapshot const& expected)
+{
+	unsigned int failures = 0;
+	Chip8Arena arena(2, false, 64 * 1024);
+
+	std::vector<Chip8*> machines[2];
+	for(unsigned int i = 0; i < TEST_ARENA_MACHINES; i++)
+	{
+		unsigned int partition = i % 2;
+		Chip8* chip8 = arena.create(partition);
+		if(chip8 == nullptr || reinterpret_cast<uintptr_t>(chip8) % ARENA_ALIGNMENT != 0 || !chip8->loadROM(rom.c_str()))
+		{
+			std::cerr << rom << ": arena could not create machine " << i << std::endl;
+			return failures + 1;
+		}
+		machines[partition].push_back(chip8);
+	}
+
+	//every other machine goes away and comes back, reusing the freed slots
+	for(unsigned int partition = 0; partition < 2; partition++)
+	{
+		for(size_t i = 0; i < machines[partition].size(); i += 2)
+		{
+			arena.destroy(partition, machines[partition][i]);
+		}
+		for(size_t i = 0; i < machines[partition].size(); i += 2)
+		{
+			machines[partition][i] = arena.create(partition);
+			machines[partition][i]->loadROM(rom.c_str());
+		}
+		if(arena.size(partition) != machines[partition].size())
+		{
+			std::cerr << rom << ": arena partition " << partition << " holds " << arena.size(partition) << " machines" << std::endl;
+			failures++;
+		}
+	}
+
+	unsigned int visited = 0;
+	Chip8Snapshot actual;
+	arena.forEach([&](Chip8& chip8)
+	{
+		runEpisode(chip8);
+		chip8.saveState(actual);
+		if(!sameSnapshot(expected, actual))
+		{
+			failures++;
+		}
+		visited++;
+	});
+	if(visited != TEST_ARENA_MACHINES || failures > 0)
+	{
+		std::cerr << rom << ": arena visited " << visited << " machines, " << failures << " ended differently" << std::endl;
+		failures++;
+	}
+	return failures;
+}
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		std::cerr << "usage: chip8-test-instances <rom directory>" << std::endl;
+		return -1;
+	}
+
+	unsigned int failures = 0;
+	for(auto const& rom : testRoms(argv[1]))
+	{
+		Chip8 reference;
+		if(!reference.loadROM(rom.c_str()))
+		{
+			std::cerr << rom << ": could not load" << std::endl;
+			failures++;
+			continue;
+		}
+		runEpisode(reference);
+		Chip8Snapshot expected;
+		reference.saveState(expected);
+
+		failures += testPool(rom, expected);
+		failures += testArena(rom, expected);
+	}
+
+	return failures > 0 ? 1 : 0;
+}
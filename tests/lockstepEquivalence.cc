@@ -0,0 +1,90 @@
+#include "chip8Test.h"
+#include "lockstep.h"
+#include <iostream>
+#include <memory>
+#include <vector>
+
+//Runs every bundled ROM in all the lanes of a Chip8Lockstep next to one plain Chip8 per lane, each lane with its own
+//seed and its own input so the lanes split up, and checks every lane matches its machine after every frame
+
+const uint64_t TEST_SEED = 0x5EED;
+const unsigned int TEST_FRAMES = 300;
+const unsigned int TEST_INSTRUCTIONS_PER_FRAME = 40;
+//frames each lane's scripted input runs ahead of the previous lane's
+const unsigned int TEST_INPUT_OFFSET = 5;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		std::cerr << "usage: chip8-test-lockstep <rom directory>" << std::endl;
+		return -1;
+	}
+
+	unsigned int failures = 0;
+	for(auto const& rom : testRoms(argv[1]))
+	{
+		std::unique_ptr<Chip8Lockstep> lockstep(new Chip8Lockstep());
+		std::vector<std::unique_ptr<Chip8>> machines;
+		bool loaded = true;
+		for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+		{
+			machines.emplace_back(new Chip8());
+			Chip8& machine = *machines.back();
+			machine.seed(TEST_SEED + lane);
+			//lockstep runFrame never fast-forwards, so the machines step every instruction too
+			machine.setIdleSkipping(false);
+			loaded = machine.loadROM(rom.c_str()) && loaded;
+			lockstep->loadLane(lane, machine);
+		}
+		if(!loaded)
+		{
+			std::cerr << rom << ": could not load" << std::endl;
+			failures++;
+			continue;
+		}
+
+		std::unique_ptr<Chip8> stored(new Chip8());
+		Chip8Snapshot expected;
+		Chip8Snapshot actual;
+		bool diverged = false;
+		for(unsigned int frame = 0; frame < TEST_FRAMES && !diverged; frame++)
+		{
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Chip8& machine = *machines[lane];
+				testScriptedInput(machine.keypad, frame + lane * TEST_INPUT_OFFSET);
+				for(unsigned int key = 0; key < NUM_KEYS; key++)
+				{
+					lockstep->keypad[key][lane] = machine.keypad[key];
+				}
+				machine.runFrame(TEST_INSTRUCTIONS_PER_FRAME);
+			}
+			lockstep->runFrame(TEST_INSTRUCTIONS_PER_FRAME);
+
+			for(unsigned int lane = 0; lane < LOCKSTEP_LANES; lane++)
+			{
+				Chip8& machine = *machines[lane];
+				lockstep->storeLane(lane, *stored);
+				machine.saveState(expected);
+				stored->saveState(actual);
+
+				if(!sameSnapshot(expected, actual)
+					|| std::memcmp(machine.display, stored->display, sizeof(machine.display)) != 0
+					|| machine.displayHash() != stored->displayHash())
+				{
+					std::cerr << rom << ": lane " << lane << " differs from its Chip8 after frame " << frame << std::endl;
+					diverged = true;
+					break;
+				}
+			}
+		}
+
+		if(diverged)
+		{
+			failures++;
+		}
+	}
+
+	return failures > 0 ? 1 : 0;
+}
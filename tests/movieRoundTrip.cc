@@ -0,0 +1,100 @@
+#include "chip8Test.h"
+#include "movie.h"
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <variant>
+
+//Records every bundled ROM under each quirk set with scripted input, writes the movie out, reads it back and checks
+//that a machine built from the movie's quirks ends on the recorded state playing from the start and from a seek
+
+const uint64_t TEST_SEED = 7;
+const uint32_t TEST_INSTRUCTIONS_PER_SECOND = 700;
+const uint32_t TEST_FRAMES = 500;
+const uint32_t TEST_KEYFRAME_INTERVAL = 45;
+
+int main(int argc, char** argv)
+{
+	if(argc < 3)
+	{
+		std::cerr << "usage: chip8-test-movie <rom directory> <scratch movie file>" << std::endl;
+		return -1;
+	}
+
+	unsigned int failures = 0;
+	for(auto const& rom : testRoms(argv[1]))
+	{
+		for(Chip8Quirks quirks : {Chip8Quirks::Vip, Chip8Quirks::Schip, Chip8Quirks::Modern})
+		{
+			std::string name = rom + " (" + chip8QuirksName(quirks) + ")";
+			Chip8Movie movie;
+			Chip8Snapshot expected;
+			bool recorded = true;
+
+			std::unique_ptr<Chip8Variant> machine = createChip8(quirks);
+			std::visit([&](auto& chip8)
+			{
+				if(!chip8.loadROM(rom.c_str()))
+				{
+					recorded = false;
+					return;
+				}
+				chip8.seed(TEST_SEED);
+
+				movie.record(TEST_SEED, TEST_INSTRUCTIONS_PER_SECOND, quirks, TEST_KEYFRAME_INTERVAL);
+				for(uint32_t frame = 0; frame < TEST_FRAMES; frame++)
+				{
+					testScriptedInput(chip8.keypad, frame);
+					movie.recordFrame(chip8);
+					chip8.runFrame(chip8InstructionsForFrame(TEST_INSTRUCTIONS_PER_SECOND, frame));
+				}
+				movie.finish(chip8);
+				chip8.saveState(expected);
+			}, *machine);
+
+			Chip8Movie loaded;
+			if(!recorded || !movie.write(argv[2]) || !loaded.read(argv[2]) || loaded.quirks() != quirks)
+			{
+				std::cerr << name << ": movie did not survive recording, writing and reading " << argv[2] << std::endl;
+				failures++;
+				continue;
+			}
+
+			//a machine with other quirks must be refused rather than silently desync
+			Chip8Quirks other = quirks == Chip8Quirks::Modern ? Chip8Quirks::Vip : Chip8Quirks::Modern;
+			std::visit([&](auto& chip8)
+			{
+				if(loaded.seek(chip8, 0))
+				{
+					std::cerr << name << ": seek accepted a " << chip8QuirksName(other) << " machine" << std::endl;
+					failures++;
+				}
+			}, *createChip8(other));
+
+			for(uint32_t start : {0U, TEST_FRAMES / 2 + 3})
+			{
+				std::unique_ptr<Chip8Variant> replayed = createChip8(loaded.quirks());
+				std::visit([&](auto& chip8)
+				{
+					Chip8Snapshot actual;
+					bool played = loaded.seek(chip8, start);
+					while(played && loaded.playFrame(chip8))
+					{
+					}
+					chip8.saveState(actual);
+
+					if(!played || loaded.currentFrame() != TEST_FRAMES || chip8.displayHash() != loaded.finalDisplayHash()
+						|| chip8.instructions() != loaded.finalInstructions() || !sameSnapshot(expected, actual))
+					{
+						std::cerr << name << ": replay from frame " << start << " does not end on the recorded state" << std::endl;
+						failures++;
+					}
+				}, *replayed);
+			}
+		}
+	}
+
+	std::remove(argv[2]);
+	return failures > 0 ? 1 : 0;
+}
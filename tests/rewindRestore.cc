@@ -0,0 +1,79 @@
+#include "chip8Test.h"
+#include "rewind.h"
+#include <iostream>
+#include <vector>
+
+//Runs every bundled ROM while keeping a rewind history and a plain copy of every frame, then steps all the
+//way back checking each restored frame matches the copy, keyframes, deltas and ring wrap-around included
+
+const uint64_t TEST_SEED = 3;
+const unsigned int TEST_FRAMES = 400;
+const unsigned int TEST_INSTRUCTIONS_PER_FRAME = 30;
+//fewer frames than the run so the oldest keyframes get dropped
+const unsigned int TEST_HISTORY_FRAMES = 250;
+const unsigned int TEST_KEYFRAME_INTERVAL = 16;
+
+int main(int argc, char** argv)
+{
+	if(argc < 2)
+	{
+		std::cerr << "usage: chip8-test-rewind <rom directory>" << std::endl;
+		return -1;
+	}
+
+	unsigned int failures = 0;
+	for(auto const& rom : testRoms(argv[1]))
+	{
+		Chip8 Chip8_Emulator;
+		if(!Chip8_Emulator.loadROM(rom.c_str()))
+		{
+			std::cerr << rom << ": could not load" << std::endl;
+			failures++;
+			continue;
+		}
+		Chip8_Emulator.seed(TEST_SEED);
+
+		Chip8Rewind history(TEST_HISTORY_FRAMES, 4 << 20, TEST_KEYFRAME_INTERVAL);
+		//frames[n] is the machine after n frames, pushed the same way the frontend does
+		std::vector<Chip8Snapshot> frames(TEST_FRAMES + 1);
+		Chip8_Emulator.saveState(frames[0]);
+		history.push(Chip8_Emulator);
+		for(unsigned int frame = 0; frame < TEST_FRAMES; frame++)
+		{
+			testScriptedInput(Chip8_Emulator.keypad, frame);
+			Chip8_Emulator.runFrame(TEST_INSTRUCTIONS_PER_FRAME);
+			Chip8_Emulator.saveState(frames[frame + 1]);
+			history.push(Chip8_Emulator);
+		}
+
+		if(history.frames() == 0 || history.frames() > TEST_HISTORY_FRAMES)
+		{
+			std::cerr << rom << ": holds " << history.frames() << " frames" << std::endl;
+			failures++;
+			continue;
+		}
+
+		//the newest frame is where the machine is now, each step back restores the one before it
+		unsigned int frame = TEST_FRAMES;
+		unsigned int oldest = TEST_FRAMES + 1 - history.frames();
+		Chip8Snapshot restored;
+		while(history.stepBack(Chip8_Emulator))
+		{
+			frame--;
+			Chip8_Emulator.saveState(restored);
+			if(!sameSnapshot(frames[frame], restored))
+			{
+				std::cerr << rom << ": stepping back restored the wrong state for frame " << frame << std::endl;
+				failures++;
+				break;
+			}
+		}
+		if(frame != oldest)
+		{
+			std::cerr << rom << ": stepped back to frame " << frame << ", expected " << oldest << std::endl;
+			failures++;
+		}
+	}
+
+	return failures > 0 ? 1 : 0;
+}
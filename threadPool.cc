@@ -0,0 +1,127 @@
+#include "threadPool.h"
+
+ThreadPool::ThreadPool(unsigned int threads)
+	:next_worker(0), queued(0), pending(0), stopping(false)
+{
+	if(threads == 0)
+	{
+		threads = 1;
+	}
+
+	for(unsigned int i = 0; i < threads; i++)
+	{
+		workers.emplace_back(new Worker());
+	}
+	for(unsigned int i = 0; i < threads; i++)
+	{
+		this->threads.emplace_back(&ThreadPool::run, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	wait();
+
+	{
+		std::lock_guard<std::mutex> guard(state_lock);
+		stopping = true;
+	}
+	work_available.notify_all();
+
+	for(auto& thread : threads)
+	{
+		thread.join();
+	}
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+	unsigned int index;
+	{
+		//counted before it is queued so a worker never takes a task that isn't counted yet
+		std::lock_guard<std::mutex> guard(state_lock);
+		queued++;
+		pending++;
+		index = next_worker;
+		next_worker = (next_worker + 1) % workers.size();
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(workers[index]->lock);
+		workers[index]->tasks.push_back(std::move(task));
+	}
+	work_available.notify_one();
+}
+
+void ThreadPool::wait()
+{
+	std::unique_lock<std::mutex> guard(state_lock);
+	work_done.wait(guard, [this]{ return pending == 0; });
+}
+
+unsigned int ThreadPool::size() const
+{
+	return workers.size();
+}
+
+bool ThreadPool::takeTask(unsigned int index, std::function<void()>& task)
+{
+	{
+		//own queue from the front
+		Worker& own = *workers[index];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if(!own.tasks.empty())
+		{
+			task = std::move(own.tasks.front());
+			own.tasks.pop_front();
+			return true;
+		}
+	}
+
+	for(size_t i = 1; i < workers.size(); i++)
+	{
+		//everyone else's from the back, away from where their owner is working
+		Worker& victim = *workers[(index + i) % workers.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if(!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.back());
+			victim.tasks.pop_back();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void ThreadPool::run(unsigned int index)
+{
+	while(true)
+	{
+		std::function<void()> task;
+		if(takeTask(index, task))
+		{
+			{
+				std::lock_guard<std::mutex> guard(state_lock);
+				queued--;
+			}
+
+			task();
+
+			std::lock_guard<std::mutex> guard(state_lock);
+			pending--;
+			if(pending == 0)
+			{
+				work_done.notify_all();
+			}
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(state_lock);
+		work_available.wait(guard, [this]{ return queued > 0 || stopping; });
+		if(stopping && queued == 0)
+		{
+			return;
+		}
+	}
+}
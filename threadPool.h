@@ -0,0 +1,51 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//Fixed set of worker threads, each with its own task queue.
+//Tasks are handed out round robin and a worker that runs dry steals from the back of the others' queues,
+//so runs of uneven length still keep every core busy
+class ThreadPool
+{
+public:
+
+	ThreadPool(unsigned int threads);
+	~ThreadPool();
+
+	void submit(std::function<void()> task);
+
+	//blocks until every submitted task has finished
+	void wait();
+
+	unsigned int size() const;
+
+private:
+
+	struct Worker
+	{
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void run(unsigned int index);
+
+	//takes the next task from the worker's own queue, or steals one from another worker
+	bool takeTask(unsigned int index, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::vector<std::thread> threads;
+
+	std::mutex state_lock;
+	std::condition_variable work_available;
+	std::condition_variable work_done;
+	unsigned int next_worker;
+	size_t queued;	//tasks waiting in a queue
+	size_t pending;	//tasks submitted but not finished yet
+	bool stopping;
+};